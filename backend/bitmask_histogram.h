@@ -0,0 +1,123 @@
+// Bulk kernels over a column of encoded choice answers.
+//
+// The incremental tally handles responses one at a time; these kernels
+// recompute the same counts from a whole answer column (the latest answer of
+// every student) when the tally has to be rebuilt. Per-choice counts use an
+// SSE2 compare-and-subtract loop over four answers at a time; exact
+// combinations and selection sizes use a scalar scatter into small
+// histograms.
+
+#ifndef BITMASK_HISTOGRAM_H
+#define BITMASK_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BITMASK_HISTOGRAM_SSE2 1
+#endif
+
+static constexpr int kMaxChoiceBits = 10;
+
+struct ChoiceBitCounts {
+    int64_t per_choice[kMaxChoiceBits] = {};
+    int64_t valid = 0;      // answers that are a valid selection
+    int64_t answered = 0;   // entries other than 0xFFFFFFFF (no answer)
+};
+
+inline bool valid_choice_mask(uint32_t x, uint32_t limit, bool single) {
+    return x != 0 && x < limit && (!single || (x & (x - 1)) == 0);
+}
+
+// Counts, over answers[0, n), how many valid selections include each choice.
+// A valid selection is a nonzero mask below 1 << choices, with exactly one
+// bit set if single is true. Text answers (high bit set) and unanswered
+// entries are never valid.
+inline ChoiceBitCounts count_choice_bits(const uint32_t* answers, size_t n, int choices, bool single) {
+    ChoiceBitCounts out;
+    const uint32_t limit = 1u << choices;
+    size_t i = 0;
+#ifdef BITMASK_HISTOGRAM_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i none = _mm_set1_epi32(-1);
+    const __m128i limit_v = _mm_set1_epi32((int)limit);
+    __m128i bit_v[kMaxChoiceBits];
+    for (int b = 0; b < kMaxChoiceBits; ++b) bit_v[b] = _mm_set1_epi32(1 << b);
+    while (i + 4 <= n) {
+        // Lane counters are 32-bit; flush them well before they can wrap.
+        size_t block_end = i + ((n - i) & ~size_t(3));
+        if (block_end - i > (size_t(1) << 30)) block_end = i + (size_t(1) << 30);
+        __m128i acc[kMaxChoiceBits];
+        for (auto& a : acc) a = zero;
+        __m128i valid_acc = zero;
+        __m128i none_acc = zero;
+        for (; i < block_end; i += 4) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(answers + i));
+            none_acc = _mm_sub_epi32(none_acc, _mm_cmpeq_epi32(x, none));
+            // Signed compares: entries with the high bit set are negative and
+            // fall out of (0, limit) on their own.
+            __m128i valid = _mm_and_si128(_mm_cmpgt_epi32(x, zero), _mm_cmplt_epi32(x, limit_v));
+            if (single) valid = _mm_and_si128(valid, _mm_cmpeq_epi32(_mm_and_si128(x, _mm_sub_epi32(x, one)), zero));
+            valid_acc = _mm_sub_epi32(valid_acc, valid);
+            __m128i vx = _mm_and_si128(x, valid);
+            for (int b = 0; b < choices; ++b)
+                acc[b] = _mm_sub_epi32(acc[b], _mm_cmpeq_epi32(_mm_and_si128(vx, bit_v[b]), bit_v[b]));
+        }
+        auto hsum = [](__m128i v) {
+            alignas(16) uint32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+            return (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        };
+        for (int b = 0; b < choices; ++b) out.per_choice[b] += hsum(acc[b]);
+        out.valid += hsum(valid_acc);
+        out.answered -= hsum(none_acc);   // answered = n - unanswered, fixed up below
+    }
+    out.answered += (int64_t)i;
+#endif
+    for (; i < n; ++i) {
+        uint32_t x = answers[i];
+        if (x == 0xFFFFFFFFu) continue;
+        ++out.answered;
+        if (!valid_choice_mask(x, limit, single)) continue;
+        ++out.valid;
+        for (uint32_t m = x; m; m &= m - 1) {
+            int b = 0;
+            while (!(m & (1u << b))) ++b;
+            ++out.per_choice[b];
+        }
+    }
+    return out;
+}
+
+// Adds exact-combination counts (combos[mask], 1 << choices slots) and
+// selection-size counts (sizes[k], choices + 1 slots) for every valid
+// selection in answers[0, n). Four interleaved sub-histograms keep runs of
+// identical answers from serializing on one counter.
+inline void count_combinations(const uint32_t* answers, size_t n, int choices, int64_t* combos, int64_t* sizes) {
+    const uint32_t limit = 1u << choices;
+    constexpr size_t kMaxSlots = size_t(1) << kMaxChoiceBits;
+    static thread_local uint32_t sub[4][kMaxSlots];
+    for (auto& h : sub)
+        for (uint32_t m = 0; m < limit; ++m) h[m] = 0;
+    auto slot = [limit](uint32_t x) { return (x != 0 && x < limit) ? x : 0u; };
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        ++sub[0][slot(answers[i])];
+        ++sub[1][slot(answers[i + 1])];
+        ++sub[2][slot(answers[i + 2])];
+        ++sub[3][slot(answers[i + 3])];
+    }
+    for (; i < n; ++i) ++sub[0][slot(answers[i])];
+    for (uint32_t m = 1; m < limit; ++m) {
+        int64_t c = (int64_t)sub[0][m] + sub[1][m] + sub[2][m] + sub[3][m];
+        if (!c) continue;
+        combos[m] += c;
+        int bits = 0;
+        for (uint32_t k = m; k; k &= k - 1) ++bits;
+        sizes[bits] += c;
+    }
+}
+
+#endif
@@ -0,0 +1,45 @@
+// Wakes threads that wait for result state to change.
+//
+// The ingest path calls publish() after applying a batch (and the control
+// endpoints after starting or stopping a poll). Waiters block on the
+// notifier's own mutex, never on the result lock, so a parked stream or
+// long-poll request cannot hold up ingestion.
+
+#ifndef CHANGE_NOTIFIER_H
+#define CHANGE_NOTIFIER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+class ChangeNotifier {
+public:
+    // Bumps the version and wakes every waiter.
+    void publish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            version_.fetch_add(1, std::memory_order_release);
+        }
+        cv_.notify_all();
+    }
+
+    uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+    // Blocks until the version differs from seen or timeout elapses, and
+    // returns the current version.
+    template <class Rep, class Period>
+    uint64_t wait_for_change(uint64_t seen, std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, timeout, [&] { return version_.load(std::memory_order_relaxed) != seen; });
+        return version_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<uint64_t> version_{0};
+};
+
+#endif
@@ -0,0 +1,159 @@
+// Lifecycle of one SDK connection.
+//
+// ConnectionState follows the connection through
+//   Connecting -> Connected -> Disconnected / Failed -> Connecting -> ...
+// as the SDK's connected, connection-failed and disconnected callbacks
+// report it. A lost or failed connection is retried after a backoff that
+// starts at kMinBackoff and doubles up to kMaxBackoff; it resets once a
+// connection is made. An attempt that reports nothing within
+// kConnectTimeout counts as failed. Requests that need the connection wait
+// in wait_ready() on the state's own mutex, never on a session lock.
+
+#ifndef CONNECTION_STATE_H
+#define CONNECTION_STATE_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+class ConnectionState {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum State { Connecting, Connected, Disconnected, Failed };
+
+    static constexpr std::chrono::milliseconds kMinBackoff{250};
+    static constexpr std::chrono::milliseconds kMaxBackoff{30000};
+    static constexpr std::chrono::milliseconds kConnectTimeout{15000};
+
+    // What /health/ready reports.
+    struct Status {
+        State state = Connecting;
+        uint32_t attempts = 0;      // connect calls since the last success
+        uint32_t reconnects = 0;    // successful connections after the first
+        int64_t retry_in_ms = 0;    // Disconnected / Failed: until the next attempt
+        std::string error;          // why the last attempt or connection ended
+    };
+
+    static const char* name(State state) {
+        switch (state) {
+        case Connecting: return "connecting";
+        case Connected: return "connected";
+        case Disconnected: return "disconnected";
+        default: return "failed";
+        }
+    }
+
+    // A connect call is about to be made.
+    void connecting() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state_ = Connecting;
+        ++attempts_;
+        attempt_started_ = Clock::now();
+    }
+
+    void connected() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ever_connected_) {
+                ++reconnects_;
+                resume_ = true;
+            }
+            ever_connected_ = true;
+            state_ = Connected;
+            attempts_ = 0;
+            backoff_ = kMinBackoff;
+            error_.clear();
+        }
+        cv_.notify_all();
+    }
+
+    void failed(std::string error) { lost(Failed, std::move(error)); }
+    void disconnected(std::string error) { lost(Disconnected, std::move(error)); }
+
+    // True once a retry is due, and moves to Connecting; the caller then
+    // calls connect. An attempt that has hung past kConnectTimeout fails.
+    bool reconnect_due() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        if (state_ == Connecting && now - attempt_started_ > kConnectTimeout) schedule_retry(Failed, "connect timed out", now);
+        if ((state_ != Disconnected && state_ != Failed) || now < retry_at_) return false;
+        state_ = Connecting;
+        ++attempts_;
+        attempt_started_ = now;
+        return true;
+    }
+
+    // True once after each reconnect, so work started on the old
+    // connection can be reissued (and after the first connect, if
+    // resume_on_connect() was called).
+    bool take_resume() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool resume = resume_ && state_ == Connected;
+        if (resume) resume_ = false;
+        return resume;
+    }
+
+    // Makes the first connection resume as well, for a poll or quiz that
+    // was restored rather than started on this connection.
+    void resume_on_connect() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        resume_ = true;
+    }
+
+    bool ready() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_ == Connected;
+    }
+
+    // Blocks until connected or timeout elapses; true if connected.
+    template <class Rep, class Period>
+    bool wait_ready(std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_for(lock, timeout, [&] { return state_ == Connected; });
+    }
+
+    Status status() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Status s;
+        s.state = state_;
+        s.attempts = attempts_;
+        s.reconnects = reconnects_;
+        s.error = error_;
+        if (state_ == Disconnected || state_ == Failed) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(retry_at_ - Clock::now()).count();
+            s.retry_in_ms = std::max<int64_t>(0, left);
+        }
+        return s;
+    }
+
+private:
+    void lost(State state, std::string error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        schedule_retry(state, std::move(error), Clock::now());
+    }
+
+    void schedule_retry(State state, std::string error, Clock::time_point now) {
+        state_ = state;
+        error_ = std::move(error);
+        retry_at_ = now + backoff_;
+        backoff_ = std::min(backoff_ * 2, kMaxBackoff);
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    State state_ = Connecting;
+    bool ever_connected_ = false;
+    bool resume_ = false;
+    uint32_t attempts_ = 0;
+    uint32_t reconnects_ = 0;
+    std::chrono::milliseconds backoff_ = kMinBackoff;
+    Clock::time_point attempt_started_ = Clock::now();
+    Clock::time_point retry_at_;
+    std::string error_;
+};
+
+#endif
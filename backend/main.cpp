@@ -8,144 +8,1962 @@
 #include <vector>
 #include <string>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <set>
+#include <memory>
+#include <filesystem>
 #include "../headers/smartresponsesdk.h"
+#include "response_ring.h"
+#include "response_store.h"
+#include "roster_index.h"
+#include "change_notifier.h"
+#include "connection_state.h"
+#include "sdk_dispatcher.h"
+#include "wal.h"
+#include "poll_archive.h"
+#include "poll_history.h"
+#include "response_replay.h"
+#include "snapshot_cache.h"
+#include "question_results.h"
+#include "roster_import.h"
 
-// --- Globals for SDK state ---
-static smartresponse_connectionV1_t* g_connection = nullptr;
-static smartresponse_classV1_t* g_class = nullptr;
-static std::vector<sr_student_t*> g_students;
-static smartresponse_questionV1_t* g_question = nullptr;
-static std::vector<std::string> g_results;
-static std::mutex g_mutex;
-static bool g_poll_active = false;
+// --- Questions and result buckets ---
+// Every poll and every quiz is a QuestionGroup, numbered from the session's
+// question_index when it starts, with one QuestionResults bucket per
+// question. The callback stamps each response with route_poll; the ingest
+// thread finds the group by its offset from the oldest retained one and the
+// bucket by the response's questionId, both O(1). The last kRetainedGroups
+// groups are kept after they stop, so late answers land on the question
+// they were given for and finished results stay readable (?poll=<n>).
+// Only the current group numbers its changes from seq and logs them.
+struct GroupStudent {
+    uint32_t answered = 0;
+    uint32_t correct = 0;
+    double score = 0;
+};
+struct QuestionGroup {
+    uint16_t poll = 0;
+    bool quiz = false;
+    bool banked = false;                             // points added to score_totals
+    std::string name;                                // quizzes only
+    std::string body;                                // /poll/start or /quiz/start body, for snapshots
+    std::string key;                                 // last /poll/answer, if keyed
+    double key_points = 0;
+    bool keyed = false;
+    smartresponse_questionsetV1_t* set = nullptr;    // quizzes only
+    std::vector<smartresponse_questionV1_t*> questions;
+    std::deque<QuestionResults> results;             // one per question
+    StringTable question_ids;                        // questionIds that are not question numbers
+    std::vector<GroupStudent> students;              // totals over the group's questions
+    uint64_t unrouted = 0;                           // responses that matched no question
+};
+static constexpr size_t kRetainedGroups = 16;
+
+// --- Sessions ---
+// A Session is one room: its own SDK connection, class, roster, polls and
+// quizzes, response ring and ingest thread, all guarded by its own mutex,
+// so rooms sharing the host never contend on a lock. Sessions live in
+// g_sessions keyed by id and are addressed as /sessions/{id}/...; the
+// unprefixed routes use the "default" session. The SDK callback finds its
+// session through aContext. Handlers and streams hold a shared_ptr, so a
+// deleted session is torn down once the last request using it finishes.
+struct Session : std::enable_shared_from_this<Session> {
+    ~Session();
+
+    std::string id;
+    smartresponse_connectionV1_t* connection = nullptr;
+    smartresponse_listener_t* responded_listener = nullptr;
+    smartresponse_listener_t* connected_listener = nullptr;
+    smartresponse_listener_t* failed_listener = nullptr;
+    smartresponse_listener_t* disconnected_listener = nullptr;
+    // Driven by the connection callbacks; the ingest thread reconnects.
+    ConnectionState link;
+    smartresponse_classV1_t* sdk_class = nullptr;
+    std::string class_name;
+    // SDK student of each dense student index; nullptr for clickers that are
+    // not on the roster (never were, or were removed).
+    std::vector<sr_student_t*> students;
+    size_t roster_size = 0;            // non-null entries of students
+    RosterIndex student_ids;           // dense student index <-> SDK id and names, roster first
+    uint16_t question_index = 0;       // number of the last poll or quiz started
+    uint64_t seq = 0;                  // last sequence number handed to an answer change
+    std::mutex mutex;
+    std::mutex roster_mutex;           // serializes roster changes; taken before mutex
+    bool poll_active = false;
+    bool quiz_active = false;
+    std::atomic<bool> closed{false};   // deleted; open streams end
+    std::deque<QuestionGroup> groups;  // oldest first; back() is the current one
+    std::atomic<uint32_t> route_poll{0};   // group number stamped on incoming responses
+    uint64_t stale_responses = 0;      // responses for groups no longer retained
+    ScoreTotals score_totals;          // points of banked groups since class setup
+
+    // --- Response ingestion ---
+    // The SDK callback only copies the response into ring, stamped with the
+    // poll or quiz running at the time; the ingest thread drains it in
+    // batches and applies them under mutex to that question's
+    // QuestionResults. Each student keeps one current answer per question; a
+    // changed answer moves the aggregates by delta and is appended to the
+    // change log, a repeated one is dropped.
+    ResponseRing<4096> ring;
+    std::thread ingest_thread;
+    std::atomic<bool> ingest_running{false};
+    std::mutex ingest_wake_mutex;
+    std::condition_variable ingest_wake;
+    ChangeNotifier changes;            // bumped whenever result state changes
+    // Copies of seq / question_index that waiters can read without mutex.
+    std::atomic<uint64_t> published_seq{0};
+    std::atomic<uint32_t> published_poll{0};
+    std::atomic<uint64_t> roster_generation{0};   // bumped under mutex by every roster change
+    // Full /poll/results and /poll/summary replies, rebuilt once per changes version.
+    SnapshotCache results_snapshot;
+    SnapshotCache summary_snapshot;
+    // Receive-to-publish time of every response the ingest thread applies.
+    LatencyHistogram ingest_latency;
+    ResponseReplay replay;             // see "Response replay" below
+    uint64_t replay_drops = 0;         // ring drops before the last replay started; under mutex
+    bool replay_snapshot = false;      // the last replay's log held a snapshot; under mutex
+
+    // Write-ahead log of everything above that is not derived; see
+    // "Write-ahead log" below. Closed (appends are dropped) while replaying.
+    WalWriter wal;
+    std::string wal_path;              // empty without a data directory
+    // When the log was last rewritten as a snapshot, and wal.appended() then.
+    std::chrono::steady_clock::time_point snapshot_at;
+    uint64_t snapshot_appended = 0;    // ingest thread only, like snapshot_at
+};
+
+// Runs on the main thread; every call on a connection, and on the class
+// or question a connection is using, goes through it.
+static SdkDispatcher g_sdk;
+
+static constexpr size_t kMaxSessions = 32;
+static const char kDefaultSession[] = "default";
+static std::map<std::string, std::shared_ptr<Session>> g_sessions;
+static std::set<std::string> g_opening_sessions;   // ids reserved while POST /sessions opens them
+static std::mutex g_sessions_mutex;    // guards the two above only; never held with a session's mutex
+
+// Microseconds since the Unix epoch, advanced by the steady clock: monotonic
+// within a run, and comparable with timestamps logged by earlier runs.
+static uint64_t now_us() {
+    using namespace std::chrono;
+    static const uint64_t wall_base = (uint64_t)duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    static const steady_clock::time_point steady_base = steady_clock::now();
+    return wall_base + (uint64_t)duration_cast<microseconds>(steady_clock::now() - steady_base).count();
+}
+
+// --- Write-ahead log ---
+// A session with a data directory logs to <data dir>/<id>.wal whatever it
+// needs to rebuild its state: roster changes, each poll and quiz as started,
+// answer keys, stops and every routed response. Records are appended under
+// s.mutex in the order their changes are applied, so replaying them in
+// order reproduces student indices, poll numbers and sequence numbers
+// exactly. Appending only encodes into memory; see wal.h for commits.
+// The log is compacted now and then into a snapshot of the same records
+// (see "Snapshots" below), so it holds the current state plus the tail
+// since, never the whole history.
+enum WalRecordType : uint8_t {
+    kWalClass = 1,      // name: a new class with an empty roster
+    kWalStudent = 2,    // index, id, first, last: student on the roster
+    kWalRemove = 3,     // index: student off the roster
+    kWalClicker = 4,    // index, id: clicker that is not on the roster
+    kWalGroup = 5,      // quiz, body: /poll/start or /quiz/start body
+    kWalStop = 6,       // the running poll or quiz stopped
+    kWalKey = 7,        // poll, answer, points: /poll/answer
+    kWalResponse = 8,   // student, poll, question position, answer
+    kWalCounters = 9,   // question index, seq: snapshots only
+    kWalTotals = 10,    // possible, count, points...: banked score totals, snapshots only
+};
+static std::string g_data_dir;         // empty: no logging
+static PollArchiver g_archive;         // <data dir>/archive; closed without a data directory
+static PollHistory g_history;          // index over g_archive for /history
 
 // --- Callback for student response ---
+// Hands a response to the ingest thread for poll.
+static void push_response(Session& s, const char* id, const char* question_id, const char* answer, uint16_t poll) {
+    s.ring.try_push(id, question_id, answer, now_us(), poll);
+    s.ingest_wake.notify_one();
+}
+
 extern "C" void on_student_responded(char* id, char* questionId, char* answer, void* aContext) {
-    std::lock_guard<std::mutex> lock(g_mutex);
-    std::string result = std::string("{\"studentId\":\"") + id + "\",\"answer\":\"" + answer + "\"}";
-    g_results.push_back(result);
+    Session& s = *static_cast<Session*>(aContext);
+    push_response(s, id, questionId, answer, (uint16_t)s.route_poll.load(std::memory_order_acquire));
+}
+
+// --- Callbacks for the connection lifecycle ---
+// Short text of the error the SDK reports inside a connection callback.
+static std::string connection_error(Session& s, const char* fallback) {
+    smartresponse_errorinfoV1_t* err = smartresponse_connectionV1_copyerrorinfo(s.connection);
+    if (!err) return fallback;
+    char text[256] = "";
+    smartresponse_errorinfoV1_statustext(err, text, sizeof(text));
+    int status = smartresponse_errorinfoV1_statuscode(err);
+    smartresponse_errorinfoV1_release(err);
+    std::string error = *text ? text : fallback;
+    if (status > 0) error += " (HTTP " + std::to_string(status) + ")";
+    return error;
+}
+
+extern "C" void on_connected(void* aContext) {
+    Session& s = *static_cast<Session*>(aContext);
+    s.link.connected();
+    std::cerr << "Session " << s.id << ": connected" << std::endl;
+}
+
+extern "C" void on_connection_failed(void* aContext) {
+    Session& s = *static_cast<Session*>(aContext);
+    std::string error = connection_error(s, "connection failed");
+    s.link.failed(error);
+    std::cerr << "Session " << s.id << ": " << error << std::endl;
+}
+
+extern "C" void on_disconnected(void* aContext) {
+    Session& s = *static_cast<Session*>(aContext);
+    std::string error = connection_error(s, "disconnected");
+    s.link.disconnected(error);
+    std::cerr << "Session " << s.id << ": " << error << std::endl;
+}
+
+// Group numbered poll, or nullptr if it is not retained.
+static QuestionGroup* find_group(Session& s, uint16_t poll) {
+    if (s.groups.empty()) return nullptr;
+    size_t offset = (uint16_t)(poll - s.groups.front().poll);
+    return offset < s.groups.size() ? &s.groups[offset] : nullptr;
+}
+
+// Most recent poll (quiz == false) or quiz, or nullptr.
+static QuestionGroup* latest_group(Session& s, bool quiz) {
+    for (auto it = s.groups.rbegin(); it != s.groups.rend(); ++it)
+        if (it->quiz == quiz) return &*it;
+    return nullptr;
+}
+
+// Question position for a questionId. A poll has one question. In a quiz
+// numeric ids are 1-based question numbers; any other id is assigned the
+// next position in first-seen order while positions remain, so ids that
+// match no question are never kept.
+static int group_question_of(QuestionGroup& g, const char* question_id) {
+    if (!g.quiz) return 0;
+    char* end = nullptr;
+    long n = strtol(question_id, &end, 10);
+    if (*question_id && !*end) return n >= 1 && n <= (long)g.results.size() ? (int)n - 1 : -1;
+    uint32_t i;
+    if (g.question_ids.find(question_id, i)) return (int)i;
+    if (g.question_ids.size() >= g.results.size()) return -1;
+    return (int)g.question_ids.intern(question_id);
+}
+
+// Caller holds s.mutex.
+static void apply_response(Session& s, QuestionGroup& g, QuestionResults& q, uint32_t student, const RawResponse& r) {
+    bool current = &g == &s.groups.back();
+    QuestionResults::Change c = q.apply(student, r.answer, r.received_us, current ? s.seq + 1 : q.last_seq(), current && !g.quiz);
+    if (!c.changed) return;
+    if (current) ++s.seq;
+    if (g.students.size() <= student) g.students.resize(student + 1);
+    GroupStudent& st = g.students[student];
+    st.answered += c.first;
+    st.correct += c.correct;
+    st.score += c.correct * q.config().points;
+    if (g.banked && c.correct) s.score_totals.add(student, c.correct * q.config().points);
+}
+
+// Recomputes a group's per-student totals after an answer key changed.
+static void recount_group(Session& s, QuestionGroup& g) {
+    g.students.assign(s.student_ids.size(), GroupStudent());
+    for (const auto& q : g.results) {
+        for (uint32_t i = 0; i < (uint32_t)q.latest().size(); ++i) {
+            if (q.latest().get(i) == LatestAnswers::kNone) continue;
+            if (g.students.size() <= i) g.students.resize(i + 1);
+            ++g.students[i].answered;
+            if (q.marks().scored() && q.marks().mark(i) == ScoreBoard::kCorrect) {
+                ++g.students[i].correct;
+                g.students[i].score += q.config().points;
+            }
+        }
+    }
+}
+
+// Replaces the answer key of one of g's questions, keeping banked totals
+// in step. Caller holds s.mutex.
+static void set_question_key(Session& s, QuestionGroup& g, QuestionResults& q, const AnswerKey& key, double points) {
+    if (g.banked) s.score_totals.bank(q.marks(), -1);
+    q.set_key(key, points);
+    if (g.banked) s.score_totals.bank(q.marks());
+    recount_group(s, g);
+}
+
+// Drops every answer of every retained group; used when student indices
+// are reassigned.
+static void reset_group_answers(Session& s) {
+    for (auto& g : s.groups) {
+        for (auto& q : g.results) q.clear_answers(0);
+        g.students.clear();
+    }
+    s.score_totals.reset();
+}
+
+static void release_group(QuestionGroup& g) {
+    if (g.set) { smartresponse_questionsetV1_release(g.set); g.set = nullptr; }
+    for (auto q : g.questions) smartresponse_questionV1_release(q);
+    g.questions.clear();
+}
+
+// Makes the current sequence number and poll visible to waiters and wakes
+// them. Caller holds s.mutex.
+static void publish_changes(Session& s) {
+    s.published_seq.store(s.seq, std::memory_order_release);
+    s.published_poll.store(s.question_index, std::memory_order_release);
+    s.changes.publish();
+}
+
+// Reissues the running poll or quiz on a new connection.
+static void resume_class(Session& s) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (!s.sdk_class || s.groups.empty() || (!s.poll_active && !s.quiz_active)) return;
+    QuestionGroup& g = s.groups.back();
+    g_sdk.call([&] {
+        smartresponse_connectionV2_startclass(s.connection, s.sdk_class);
+        if (s.quiz_active) smartresponse_connectionV1_startquestionset(s.connection, g.set);
+        else smartresponse_connectionV1_startquestion(s.connection, g.questions[0]);
+    });
+    std::cerr << "Session " << s.id << ": resumed " << (s.quiz_active ? "quiz " : "poll ") << g.poll << std::endl;
+}
+
+static void maybe_write_snapshot(Session& s);
+
+// Besides draining the ring, the ingest thread reconnects once a retry is
+// due, resumes the class after a reconnect and writes log snapshots; it
+// wakes at least every 5ms, which is finer than the backoff.
+static void ingest_loop(Session& s) {
+    std::vector<RawResponse> batch;
+    std::vector<QuestionResults*> touched;
+    batch.reserve(256);
+    uint64_t reported_drops = 0, reported_stale = 0;
+    while (s.ingest_running.load(std::memory_order_acquire)) {
+        if (s.link.reconnect_due()) {
+            ConnectionState::Status st = s.link.status();
+            std::cerr << "Session " << s.id << ": reconnecting (attempt " << st.attempts << ")" << std::endl;
+            g_sdk.post([&s] { smartresponse_connectionV1_connect(s.connection); });
+        }
+        if (s.link.take_resume()) resume_class(s);
+        batch.clear();
+        s.ring.drain([&](const RawResponse& r) { batch.push_back(r); }, 256);
+        if (!batch.empty()) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            touched.clear();
+            for (const auto& r : batch) {
+                size_t known = s.student_ids.size();
+                uint32_t student = s.student_ids.intern(r.id);
+                if (student >= known) s.wal.append(kWalClicker, r.received_us, WalFields().varint(student).string(r.id));
+                QuestionGroup* g = find_group(s, r.poll);
+                if (!g) {
+                    ++s.stale_responses;
+                    continue;
+                }
+                int qi = group_question_of(*g, r.question_id);
+                if (qi < 0) {
+                    ++g->unrouted;
+                    continue;
+                }
+                QuestionResults& q = g->results[qi];
+                apply_response(s, *g, q, student, r);
+                s.wal.append(kWalResponse, r.received_us, WalFields().varint(student).varint(r.poll).varint(qi).string(r.answer));
+                if (touched.empty() || touched.back() != &q) touched.push_back(&q);
+            }
+            for (auto q : touched) q->refresh_extremes();
+            publish_changes(s);
+            uint64_t published_us = now_us();
+            for (const auto& r : batch) s.ingest_latency.record(published_us > r.received_us ? published_us - r.received_us : 0, published_us);
+            if (s.stale_responses != reported_stale) {
+                std::cerr << "Session " << s.id << ": dropped " << (s.stale_responses - reported_stale) << " response(s) for expired questions" << std::endl;
+                reported_stale = s.stale_responses;
+            }
+        }
+        if (!s.wal_path.empty()) maybe_write_snapshot(s);
+        uint64_t drops = s.ring.dropped();
+        if (drops != reported_drops) {
+            std::cerr << "Session " << s.id << ": response ring full, dropped " << (drops - reported_drops) << " response(s)" << std::endl;
+            reported_drops = drops;
+        }
+        if (batch.empty()) {
+            // notify_one() is issued without the mutex, so a wakeup can be
+            // missed; the timeout bounds the extra latency in that case.
+            std::unique_lock<std::mutex> lk(s.ingest_wake_mutex);
+            s.ingest_wake.wait_for(lk, std::chrono::milliseconds(5));
+        }
+    }
+}
+
+void start_ingest(Session& s) {
+    s.ingest_running = true;
+    s.ingest_thread = std::thread(ingest_loop, std::ref(s));
+}
+
+void stop_ingest(Session& s) {
+    s.ingest_running = false;
+    s.ingest_wake.notify_one();
+    if (s.ingest_thread.joinable()) s.ingest_thread.join();
+}
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+// --- Helper: JSON output ---
+// Appends s to out as a quoted, escaped JSON string.
+static void append_json_string(std::string& out, std::string_view s) {
+    static const char kHex[] = "0123456789abcdef";
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                out += "\\u00";
+                out += kHex[(c >> 4) & 0xF];
+                out += kHex[c & 0xF];
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+// {"error":"..."} with error escaped; for messages that may quote input.
+static std::string error_json(std::string_view error) {
+    std::string json = "{\"error\":";
+    append_json_string(json, error);
+    return json + "}";
+}
+
+static const char* question_type_name(int qtype) {
+    switch (qtype) {
+    case SMARTRESPONSE_QUESTIONTYPE_MULTIPLECHOICE: return "multiplechoice";
+    case SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER: return "multipleanswer";
+    case SMARTRESPONSE_QUESTIONTYPE_YESNO: return "yesno";
+    case SMARTRESPONSE_QUESTIONTYPE_TRUEFALSE: return "truefalse";
+    case SMARTRESPONSE_QUESTIONTYPE_DECIMAL: return "decimal";
+    case SMARTRESPONSE_QUESTIONTYPE_FRACTIONAL: return "fractional";
+    case SMARTRESPONSE_QUESTIONTYPE_SHORTTEXT: return "shorttext";
+    default: return "none";
+    }
+}
+
+// --- Helper: Roster changes (caller holds s.mutex, on the SDK dispatcher) ---
+// Dense indices are never reused, so adding, removing or renaming one
+// student leaves every other student's handle and per-student state alone.
+static bool on_roster(Session& s, uint32_t index) {
+    return index < s.students.size() && s.students[index];
+}
+
+// Takes a student off s.sdk_class, by SDK handle or by id.
+static void remove_roster_student(Session& s, uint32_t index, bool by_id) {
+    if (by_id) {
+        std::string id(s.student_ids.id(index));
+        sr_class_removestudentwithid(s.sdk_class, (char*)id.c_str());
+    } else {
+        sr_class_removestudent(s.sdk_class, s.students[index]);
+    }
+    sr_student_release(s.students[index]);
+    s.students[index] = nullptr;
+    --s.roster_size;
+    ++s.roster_generation;
+    s.wal.append(kWalRemove, now_us(), WalFields().varint(index));
+}
+
+// Adds a student to s.sdk_class. A student already on it with the same names
+// keeps its handle; a renamed one is replaced, since SDK students cannot
+// be edited. Returns false if the SDK rejects the student.
+static bool add_roster_student(Session& s, const RosterStudent& st) {
+    uint32_t index = s.student_ids.find(st.id);
+    if (on_roster(s, index)) {
+        if (s.student_ids.first(index) == st.first && s.student_ids.last(index) == st.last) return true;
+        remove_roster_student(s, index, false);
+    }
+    sr_student_t* stu = sr_student_create(st.last.c_str(), (int)st.last.size(), st.first.c_str(), (int)st.first.size(), st.id.c_str(), (int)st.id.size());
+    if (sr_class_addstudent(s.sdk_class, stu) != SR::OK) {
+        sr_student_release(stu);
+        return false;
+    }
+    index = s.student_ids.intern(st.id, st.first, st.last);
+    if (s.student_ids.first(index) != st.first || s.student_ids.last(index) != st.last) s.student_ids.rename(index, st.first, st.last);
+    if (s.students.size() <= index) s.students.resize(s.student_ids.size(), nullptr);
+    s.students[index] = stu;
+    ++s.roster_size;
+    ++s.roster_generation;
+    s.wal.append(kWalStudent, now_us(), WalFields().varint(index).string(st.id).string(st.first).string(st.last));
+    return true;
+}
+
+// Replaces s.sdk_class with an empty class called name. Student indices are
+// reassigned, so per-student answers no longer apply; the arrays grow back
+// as students and answers arrive.
+static void reset_class(Session& s, const std::string& name, size_t expected_students) {
+    for (auto stu : s.students) if (stu) sr_student_release(stu);
+    s.students.clear();
+    s.roster_size = 0;
+    s.student_ids.clear();
+    if (s.sdk_class) sr_class_release(s.sdk_class);
+    s.sdk_class = sr_class_create((char*)name.c_str(), (int)name.size(), false);
+    s.class_name = name;
+    s.student_ids.reserve(expected_students);
+    reset_group_answers(s);
+    ++s.roster_generation;
+    s.wal.append(kWalClass, now_us(), WalFields().string(name));
+}
+
+static bool parse_roster_student(const json& stu, RosterStudent& st) {
+    st.last = stu.value("last", "");
+    st.first = stu.value("first", "");
+    st.id = stu.value("id", "");
+    return !st.last.empty() && !st.first.empty() && !st.id.empty();
+}
+
+// --- Helper: Whole-roster updates ---
+// Applies a complete roster (class setup or import) as its records stream
+// in. Loading the class that is already set up applies only the
+// difference: students missing from the new roster are removed, new ones
+// added, renamed ones replaced, and everyone else keeps their index and
+// current answers. A different class name starts over with an empty
+// roster. Students are applied under s.mutex a batch at a time so
+// ingestion keeps running during a long import; the caller holds
+// s.roster_mutex for the whole update. Students that arrive before the
+// class name are held until it is known, up to kMaxHeld. A staged update
+// holds every student until finish(), so a payload that turns out to be
+// malformed changes nothing.
+class RosterUpdate {
+public:
+    static constexpr size_t kBatch = 256;
+    static constexpr size_t kMaxHeld = 16 * kBatch;
+    static constexpr size_t kMaxReportedErrors = 100;
+
+    explicit RosterUpdate(Session& s, bool staged = false) : s_(s), staged_(staged) {}
+
+    void class_name(std::string name) {
+        if (!name_.empty() || !error_.empty()) return;
+        if (name.empty() || name.size() > 8) error_ = "Class name must be 1-8 chars";
+        else name_ = std::move(name);
+    }
+
+    void add(RosterStudent st, size_t record) {
+        if (!error_.empty()) return;
+        if (!staged_ && name_.empty() && pending_.size() >= kMaxHeld) {
+            error_ = "className must come before the first " + std::to_string(kMaxHeld) + " students";
+            pending_.clear();
+            return;
+        }
+        pending_.push_back({std::move(st), record});
+        if (!staged_ && !name_.empty() && pending_.size() >= kBatch) flush();
+    }
+
+    void reject(size_t record, std::string_view id, const char* error) {
+        if (++rejected_ > kMaxReportedErrors) return;
+        if (!errors_.empty()) errors_ += ",";
+        errors_ += "{\"record\":" + std::to_string(record) + ",\"id\":";
+        append_json_string(errors_, id);
+        errors_ += ",\"error\":";
+        append_json_string(errors_, error);
+        errors_ += "}";
+    }
+
+    // Applies what is left once the payload has been read and wakes result
+    // readers. If it was cut short (complete == false) no student is
+    // removed for being absent, and a staged update applies nothing.
+    bool finish(bool complete, std::string& error) {
+        if (staged_ && !complete) return false;
+        if (!error_.empty()) {
+            error = error_;
+            return false;
+        }
+        if (name_.empty()) {
+            error = "Missing className or students";
+            return false;
+        }
+        if (!begun_ && pending_.empty()) {
+            error = "No valid students";
+            return false;
+        }
+        flush();
+        std::lock_guard<std::mutex> lock(s_.mutex);
+        if (complete && !new_class_) {
+            g_sdk.call([&] {
+                for (uint32_t i = 0; i < (uint32_t)s_.students.size(); ++i)
+                    if (s_.students[i] && (i >= seen_.size() || !seen_[i])) remove_roster_student(s_, i, false);
+            });
+        }
+        publish_changes(s_);
+        if (!s_.roster_size) {
+            error = "No valid students";
+            return false;
+        }
+        return true;
+    }
+
+    size_t imported() const { return imported_; }
+    size_t rejected() const { return rejected_; }
+    // Comma-separated {"record", "id", "error"} objects, at most kMaxReportedErrors.
+    const std::string& errors_json() const { return errors_; }
+
+private:
+    struct Pending {
+        RosterStudent student;
+        size_t record;
+    };
+
+    // One hand-off to the SDK dispatcher, and one hold of s.mutex, per batch.
+    void flush() {
+        for (size_t from = 0; from < pending_.size(); from += kBatch) {
+            size_t to = std::min(from + kBatch, pending_.size());
+            std::lock_guard<std::mutex> lock(s_.mutex);
+            g_sdk.call([&] {
+                if (!begun_) begin();
+                for (size_t i = from; i < to; ++i) {
+                    Pending& p = pending_[i];
+                    if (!add_roster_student(s_, p.student)) {
+                        reject(p.record, p.student.id, "rejected by SDK");
+                        continue;
+                    }
+                    uint32_t index = s_.student_ids.find(p.student.id);
+                    if (seen_.size() <= index) seen_.resize(index + 1, 0);
+                    seen_[index] = 1;
+                    ++imported_;
+                }
+            });
+        }
+        pending_.clear();
+    }
+
+    void begin() {
+        begun_ = true;
+        new_class_ = !s_.sdk_class || name_ != s_.class_name;
+        if (new_class_) reset_class(s_, name_, pending_.size());
+    }
+
+    Session& s_;
+    bool staged_;
+    std::string name_;
+    std::string error_;
+    std::vector<Pending> pending_;
+    std::vector<uint8_t> seen_;
+    bool begun_ = false;
+    bool new_class_ = false;
+    size_t imported_ = 0;
+    size_t rejected_ = 0;
+    std::string errors_;
+};
+
+// Runs a {"className", "students": [...]} body through the SAX reader,
+// without building a DOM. Returns false if it is not well-formed.
+static bool read_roster_json(const std::string& body, RosterUpdate& update, std::string& error) {
+    RosterSaxHandler<RosterUpdate> handler(update);
+    bool ok = json::sax_parse(body, &handler);
+    if (!ok) error = handler.error().empty() ? "Malformed JSON" : handler.error();
+    else if (!handler.saw_students()) error = "Missing className or students";
+    return ok && handler.saw_students();
+}
+
+// --- Helper: Create class and students from JSON ---
+// Parses the whole body before changing the roster.
+bool setup_class_and_students_from_json(Session& s, const std::string& body, std::string& error) {
+    std::lock_guard<std::mutex> roster_lock(s.roster_mutex);
+    RosterUpdate update(s, true);
+    if (!read_roster_json(body, update, error)) return false;
+    return update.finish(true, error);
+}
+
+// --- Helper: Answer key ---
+// Encodes answer as the key of a question of type qtype. An empty answer
+// leaves the poll unscored.
+bool parse_answer_key(int qtype, int choice_count, TextMatch match, const std::string& answer, AnswerKey& key, std::string& error) {
+    key = AnswerKey();
+    if (answer.empty()) return true;
+    if (is_choice_question(qtype)) {
+        StringTable scratch;
+        key.mask = encode_answer(qtype, answer.c_str(), scratch);
+        if (!valid_choice_mask(key.mask, 1u << choice_count, qtype != SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER)) {
+            error = "Answer is not a valid choice for this question";
+            return false;
+        }
+    } else if (is_numeric_question(qtype)) {
+        if (!parse_numeric_answer(answer.c_str(), key.value)) {
+            error = "Answer is not a number";
+            return false;
+        }
+    } else {
+        key.text = normalize_text_answer(answer, match);
+    }
+    key.set = true;
+    return true;
+}
+
+// --- Helper: Question from JSON ---
+// A question as described by a /poll/start body or one /quiz/start bank
+// entry. parse_question_json only reads it; create_question then makes
+// the SDK question on the dispatcher, and the caller owns it.
+struct QuestionSpec {
+    smartresponse_questionV1_t* question = nullptr;
+    QuestionConfig config;
+    std::string text;
+    std::string answer;
+};
+
+bool parse_question_json(const json& j, QuestionSpec& spec, std::string& error) {
+    std::string qtext = j.value("question", "");
+    std::string qtype = j.value("type", "multiplechoice");
+    auto choices = j.value("choices", std::vector<std::string>{});
+    std::string answer = j.value("answer", "");
+    double points = j.value("points", 1.0);
+    bool history = j.value("history", true);
+    TextMatch text_match = TextMatch::Normalized;
+    if (!parse_text_match(j.value("textMatch", "normalized"), text_match)) {
+        error = "textMatch must be exact, normalized or fuzzy";
+        return false;
+    }
+    int sdk_type = 0;
+    int choice_count = 0;
+    if (qtype == "multiplechoice") {
+        sdk_type = SMARTRESPONSE_QUESTIONTYPE_MULTIPLECHOICE;
+        choice_count = (int)choices.size();
+        if (choice_count < 2 || choice_count > 10) {
+            error = "Multiple choice: 2-10 choices required";
+            return false;
+        }
+    } else if (qtype == "multipleanswer") {
+        sdk_type = SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER;
+        choice_count = (int)choices.size();
+        if (choice_count < 2 || choice_count > 10) {
+            error = "Multiple answer: 2-10 choices required";
+            return false;
+        }
+    } else if (qtype == "yesno") {
+        sdk_type = SMARTRESPONSE_QUESTIONTYPE_YESNO;
+        choice_count = 2;
+    } else if (qtype == "truefalse") {
+        sdk_type = SMARTRESPONSE_QUESTIONTYPE_TRUEFALSE;
+        choice_count = 2;
+    } else if (qtype == "decimal") {
+        sdk_type = SMARTRESPONSE_QUESTIONTYPE_DECIMAL;
+        choice_count = 0;
+    } else if (qtype == "fractional") {
+        sdk_type = SMARTRESPONSE_QUESTIONTYPE_FRACTIONAL;
+        choice_count = 0;
+    } else if (qtype == "shorttext") {
+        sdk_type = SMARTRESPONSE_QUESTIONTYPE_SHORTTEXT;
+        choice_count = 0;
+    } else {
+        error = "Unknown question type";
+        return false;
+    }
+    if (qtext.empty()) {
+        error = "Question text required";
+        return false;
+    }
+    QuestionConfig& config = spec.config;
+    if (!parse_answer_key(sdk_type, choice_count, text_match, answer, config.key, error)) return false;
+    config.type = sdk_type;
+    config.choice_count = choice_count;
+    config.choices.clear();
+    if (sdk_type == SMARTRESPONSE_QUESTIONTYPE_MULTIPLECHOICE || sdk_type == SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER) config.choices = choices;
+    config.points = points;
+    config.history = history;
+    config.text_match = text_match;
+    spec.text = qtext;
+    spec.answer = answer;
+    return true;
+}
+
+// Creates spec's SDK question. Runs on the dispatcher.
+static void create_question(QuestionSpec& spec) {
+    const QuestionConfig& config = spec.config;
+    spec.question = smartresponse_questionV1_create(config.type, config.choice_count);
+    smartresponse_questionV1_setquestiontext(spec.question, (char*)spec.text.c_str(), -1);
+    for (size_t i = 0; i < config.choices.size(); ++i) {
+        smartresponse_questionV1_setchoicetext(spec.question, (int)i, (char*)config.choices[i].c_str(), -1);
+    }
+    if (!spec.answer.empty()) {
+        smartresponse_questionV1_setanswer(spec.question, (char*)spec.answer.c_str(), -1);
+    }
+    smartresponse_questionV1_setquestionpoints(spec.question, config.points);
+}
+
+// --- Helper: Setup poll from JSON ---
+bool setup_poll_from_json(const std::string& body, QuestionSpec& spec, std::string& error) {
+    try {
+        return parse_question_json(json::parse(body), spec, error);
+    } catch (const std::exception& ex) {
+        error = ex.what();
+        return false;
+    }
+}
+
+// --- Helper: Setup quiz from JSON ---
+// {"name": "...", "questions": [<poll body>, ...]}. At most
+// smartresponse_featuresV1_maxquestionsperquestionset() questions.
+bool setup_quiz_from_json(const std::string& body, std::string& name, std::vector<QuestionSpec>& specs, std::string& error) {
+    try {
+        auto j = json::parse(body);
+        if (!j.contains("questions") || !j["questions"].is_array() || j["questions"].empty()) {
+            error = "Quiz needs a non-empty questions array";
+            return false;
+        }
+        int max_questions = g_sdk.call([] { return smartresponse_featuresV1_maxquestionsperquestionset(); });
+        if ((int)j["questions"].size() > max_questions) {
+            error = "Quiz: at most " + std::to_string(max_questions) + " questions";
+            return false;
+        }
+        name = j.value("name", "");
+        for (size_t i = 0; i < j["questions"].size(); ++i) {
+            QuestionSpec spec;
+            if (!parse_question_json(j["questions"][i], spec, error)) {
+                error = "Question " + std::to_string(i + 1) + ": " + error;
+                return false;
+            }
+            specs.push_back(std::move(spec));
+        }
+        return true;
+    } catch (const std::exception& ex) {
+        error = ex.what();
+        return false;
+    }
+}
+
+// --- Helper: Start a poll or quiz (caller holds s.mutex) ---
+// Banks the previous group, drops the oldest beyond kRetainedGroups and
+// makes a new group of specs' questions current. Responses are routed to
+// it from here on, so call this before the SDK starts the question. Runs
+// on the dispatcher, which releases the dropped group's SDK questions.
+static QuestionGroup& start_group(Session& s, bool quiz, std::vector<QuestionSpec>& specs, uint64_t at_us) {
+    if (!s.groups.empty() && !s.groups.back().banked) {
+        for (const auto& q : s.groups.back().results) s.score_totals.bank(q.marks());
+        s.groups.back().banked = true;
+    }
+    while (s.groups.size() >= kRetainedGroups) {
+        release_group(s.groups.front());
+        s.groups.pop_front();
+    }
+    s.groups.emplace_back();
+    QuestionGroup& g = s.groups.back();
+    g.poll = ++s.question_index;
+    g.quiz = quiz;
+    g.results.resize(specs.size());
+    for (size_t i = 0; i < specs.size(); ++i) {
+        g.questions.push_back(specs[i].question);
+        g.results[i].reset(std::move(specs[i].config), g.poll, s.student_ids.size(), at_us, s.seq);
+    }
+    g.students.assign(s.student_ids.size(), GroupStudent());
+    s.route_poll.store(g.poll, std::memory_order_release);
+    return g;
+}
+
+// Parses a /poll/start or /quiz/start body and starts its group as of
+// at_us, building a quiz's SDK question set; starting it on the connection
+// is up to the caller. Returns nullptr (and sets error) for a bad body.
+// The body is parsed first, so the SDK work is one dispatcher command.
+static QuestionGroup* open_group(Session& s, bool quiz, const std::string& body, uint64_t at_us, std::string& error) {
+    std::string name;
+    std::vector<QuestionSpec> specs(quiz ? 0 : 1);
+    if (quiz ? !setup_quiz_from_json(body, name, specs, error) : !setup_poll_from_json(body, specs[0], error)) return nullptr;
+    QuestionGroup& g = g_sdk.call([&]() -> QuestionGroup& {
+        for (auto& spec : specs) create_question(spec);
+        QuestionGroup& g = start_group(s, quiz, specs, at_us);
+        if (quiz) {
+            g.set = smartresponse_questionsetV1_create();
+            if (!name.empty()) smartresponse_questionsetV1_setname(g.set, (char*)name.c_str(), -1);
+            for (auto q : g.questions) smartresponse_questionsetV1_setquestion(g.set, q, -1);
+        }
+        return g;
+    });
+    g.name = name;
+    g.body = body;
+    s.wal.append(kWalGroup, at_us, WalFields().varint(quiz).string(body));
+    return &g;
+}
+
+// Replaces the answer key and points of poll g's question, on the SDK
+// question too. Caller holds s.mutex.
+static bool set_poll_answer(Session& s, QuestionGroup& g, const std::string& answer, double points, std::string& error) {
+    QuestionResults& q = g.results[0];
+    AnswerKey key;
+    if (!parse_answer_key(q.config().type, q.config().choice_count, q.config().text_match, answer, key, error)) return false;
+    smartresponse_questionV1_t* question = g.questions[0];
+    g_sdk.call([&] {
+        smartresponse_questionV1_setanswer(question, (char*)answer.c_str(), -1);
+        smartresponse_questionV1_setquestionpoints(question, points);
+    });
+    set_question_key(s, g, q, key, points);
+    g.key = answer;
+    g.key_points = points;
+    g.keyed = true;
+    s.wal.append(kWalKey, now_us(), WalFields().varint(g.poll).string(answer).number(points));
+    return true;
+}
+
+// --- Helper: Result rendering (caller holds s.mutex) ---
+static QuestionResults g_no_results;   // rendered before the first poll
+
+// The poll (or quiz) a request reads: ?poll=<n> (?quiz=<n>) if it is still
+// retained, else the latest one. Returns false (and fills res with a 404)
+// for an unknown number.
+static bool find_group_param(Session& s, const httplib::Request& req, httplib::Response& res, bool quiz, QuestionGroup*& g) {
+    const char* name = quiz ? "quiz" : "poll";
+    if (!req.has_param(name)) {
+        g = latest_group(s, quiz);
+        return true;
+    }
+    g = nullptr;
+    try {
+        g = find_group(s, (uint16_t)std::stoul(req.get_param_value(name)));
+    } catch (const std::exception&) {
+    }
+    if (!g || g->quiz != quiz) {
+        res.status = 404;
+        res.set_content(std::string("{\"error\":\"No such ") + name + " (only the last " + std::to_string(kRetainedGroups) +
+                        " polls and quizzes are kept)\"}", "application/json");
+        return false;
+    }
+    return true;
+}
+
+static QuestionResults& poll_results(QuestionGroup* g) {
+    return g ? g->results[0] : g_no_results;
+}
+
+// High-water mark a client passes as ?since= for g. Only the latest poll
+// follows s.seq; finished ones no longer log changes.
+static uint64_t poll_seq(Session& s, QuestionGroup* g) {
+    return !g || g == latest_group(s, false) ? s.seq : g->results[0].last_seq();
+}
+
+static void append_result_json(Session& s, std::string& json, const QuestionResults& q, uint32_t student, uint32_t answer, uint64_t seq) {
+    json += "{\"studentId\":";
+    append_json_string(json, s.student_ids.id(student));
+    json += ",\"answer\":";
+    append_json_string(json, q.decode(answer));
+    json += ",\"seq\":" + std::to_string(seq) + "}";
+}
+
+static void append_number_json(std::string& json, double v) {
+    if (!std::isfinite(v)) {
+        json += "null";
+        return;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.10g", v);
+    json += buf;
+}
+
+// Distribution of decimal/fractional answers; constant cost per query.
+static void append_numeric_json(std::string& json, const NumericStats& numeric) {
+    static const double kQuantiles[] = {0.1, 0.25, 0.5, 0.75, 0.9};
+    static const char* kQuantileNames[] = {"p10", "p25", "p50", "p75", "p90"};
+    static const int kHistogramBins = 10;
+    json += ",\"numeric\":{\"count\":" + std::to_string(numeric.count());
+    if (numeric.count() > 0) {
+        json += ",\"mean\":";
+        append_number_json(json, numeric.mean());
+        json += ",\"variance\":";
+        append_number_json(json, numeric.variance());
+        json += ",\"min\":";
+        append_number_json(json, numeric.min());
+        json += ",\"max\":";
+        append_number_json(json, numeric.max());
+        if (numeric.sum_exact()) {
+            json += ",\"sum\":\"" + std::to_string(numeric.sum().num);
+            if (numeric.sum().den != 1) json += "/" + std::to_string(numeric.sum().den);
+            json += "\"";
+        }
+        json += ",\"quantiles\":{";
+        for (size_t i = 0; i < sizeof(kQuantiles) / sizeof(kQuantiles[0]); ++i) {
+            if (i) json += ",";
+            json += std::string("\"") + kQuantileNames[i] + "\":";
+            append_number_json(json, std::min(std::max(numeric.quantile(kQuantiles[i]), numeric.min()), numeric.max()));
+        }
+        json += "},\"histogram\":{\"min\":";
+        append_number_json(json, numeric.min());
+        json += ",\"max\":";
+        append_number_json(json, numeric.max());
+        json += ",\"counts\":[";
+        std::vector<int64_t> bins = numeric.histogram(kHistogramBins);
+        for (size_t i = 0; i < bins.size(); ++i) {
+            if (i) json += ",";
+            json += std::to_string(bins[i]);
+        }
+        json += "]}";
+    }
+    json += "}";
+}
+
+// Most frequent short-text answers by match key; O(top), independent of
+// the number of responses.
+static void append_text_top_json(std::string& json, const QuestionResults& q, size_t top) {
+    json += ",\"distinct\":" + std::to_string(q.text_keys().size()) + ",\"top\":[";
+    bool first = true;
+    q.text_top().top(top, [&](uint32_t key, int64_t count) {
+        if (!first) json += ",";
+        first = false;
+        json += "{\"answer\":";
+        append_json_string(json, q.text_keys().str(key));
+        json += ",\"count\":" + std::to_string(count) + "}";
+    });
+    json += "]";
+}
+
+// Correct count against the answer key; O(1).
+static void append_score_json(std::string& json, const ScoreBoard& marks) {
+    json += ",\"score\":{\"points\":";
+    append_number_json(json, marks.points());
+    json += ",\"answered\":" + std::to_string(marks.answered()) + ",\"correct\":" + std::to_string(marks.correct()) +
+            ",\"percentCorrect\":";
+    if (marks.answered()) append_number_json(json, 100.0 * (double)marks.correct() / (double)marks.answered());
+    else json += "null";
+    json += "}";
+}
+
+static constexpr size_t kDefaultTextTop = 10;
+
+static void append_summary_json(std::string& json, const QuestionResults& q, size_t text_top = kDefaultTextTop) {
+    const ChoiceTally& tally = q.tally();
+    json += "{\"type\":";
+    append_json_string(json, question_type_name(tally.qtype()));
+    json += ",\"responses\":" + std::to_string(tally.responses());
+    json += ",\"other\":" + std::to_string(tally.other());
+    json += ",\"choices\":[";
+    for (int i = 0; i < tally.choice_count(); ++i) {
+        if (i) json += ",";
+        json += "{\"label\":";
+        append_json_string(json, q.decode(1u << i));
+        if (i < (int)q.config().choices.size()) {
+            json += ",\"text\":";
+            append_json_string(json, q.config().choices[i]);
+        }
+        json += ",\"count\":" + std::to_string(tally.count(i)) + "}";
+    }
+    json += "]";
+    if (tally.combination_slots()) {
+        json += ",\"combinations\":[";
+        bool first = true;
+        for (uint32_t mask = 1; mask < tally.combination_slots(); ++mask) {
+            if (!tally.combination(mask)) continue;
+            if (!first) json += ",";
+            first = false;
+            json += "{\"answer\":";
+            append_json_string(json, q.decode(mask));
+            json += ",\"count\":" + std::to_string(tally.combination(mask)) + "}";
+        }
+        json += "],\"selections\":[";
+        for (int k = 0; k <= tally.choice_count(); ++k) {
+            if (k) json += ",";
+            json += std::to_string(tally.selections(k));
+        }
+        json += "]";
+    }
+    if (is_numeric_question(tally.qtype())) append_numeric_json(json, q.numeric());
+    if (tally.qtype() == SMARTRESPONSE_QUESTIONTYPE_SHORTTEXT) append_text_top_json(json, q, text_top);
+    if (q.marks().scored()) append_score_json(json, q.marks());
+    json += "}";
+}
+
+// Renders a /poll/results reply: the latest answers, the full change log
+// (history) or only the changes after since (delta).
+static std::string results_json(Session& s, QuestionGroup* g, bool history, bool delta, uint64_t since) {
+    const QuestionResults& q = poll_results(g);
+    std::string json = "{\"seq\":" + std::to_string(poll_seq(s, g)) + ",\"poll\":" + std::to_string(g ? g->poll : 0) + ",\"results\":[";
+    bool first = true;
+    auto append_result = [&](uint32_t student, uint32_t answer, uint64_t seq) {
+        if (!first) json += ",";
+        first = false;
+        append_result_json(s, json, q, student, answer, seq);
+    };
+    if (history) {
+        size_t i = 0;
+        q.log().for_each(0, [&](const ResponseRecord& r) { append_result(r.student, r.answer, q.log().seq_of(i++)); });
+    } else if (delta) {
+        q.for_each_change_since(since, append_result);
+    } else {
+        q.for_each_latest_since(0, append_result);
+    }
+    json += "]}";
+    return json;
+}
+
+// Replies with the cache's snapshot for the current result version and
+// roster generation. The shared buffer is streamed as-is, so concurrent
+// readers neither serialize nor copy it; ETag/If-None-Match lets unchanged
+// dashboards skip the body.
+template <class Build>
+static void send_snapshot(Session& s, const httplib::Request& req, httplib::Response& res, SnapshotCache& cache, Build&& build) {
+    uint64_t roster = s.roster_generation.load();
+    uint64_t version = s.changes.version();
+    std::string etag = "\"" + std::to_string(roster) + "." + std::to_string(version) + "\"";
+    res.set_header("ETag", etag);
+    if (req.get_header_value("If-None-Match") == etag) {
+        res.status = 304;
+        return;
+    }
+    SnapshotCache::Snapshot snap = cache.get(roster, version, [&] {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        return build();
+    });
+    res.set_content_provider(snap->size(), "application/json",
+        [snap](size_t offset, size_t length, httplib::DataSink& sink) {
+            return sink.write(snap->data() + offset, length);
+        });
+}
+
+// Parses an optional sequence-number query parameter. Returns false (and
+// fills res with a 400) if it is present but malformed.
+static bool parse_seq_param(const httplib::Request& req, const char* name, uint64_t& out, httplib::Response& res) {
+    if (!req.has_param(name)) return true;
+    try {
+        out = std::stoull(req.get_param_value(name));
+        return true;
+    } catch (const std::exception&) {
+        res.status = 400;
+        res.set_content(std::string("{\"error\":\"") + name + " must be a sequence number\"}", "application/json");
+        return false;
+    }
+}
+
+// --- Poll archive ---
+// A poll or quiz is sealed into the archive (see poll_archive.h) when it is
+// stopped: each question's final answers and what the SDK question reports
+// about itself are copied under s.mutex, and g_archive writes them out on
+// its own thread.
+
+// Reads a string through an SDK getter that takes (buffer, size) and
+// returns the length it needs.
+template <class Get>
+static std::string sdk_string(Get&& get) {
+    int size = get(nullptr, 0);
+    if (size <= 0) return std::string();
+    std::vector<char> buf(size + 1);
+    get(buf.data(), size + 1);
+    return std::string(buf.data());
+}
+
+// Caller holds s.mutex.
+static void seal_group(Session& s, QuestionGroup& g, uint64_t stopped_us) {
+    if (!g_archive.is_open()) return;
+    SealedPoll p;
+    p.session = s.id;
+    p.class_name = s.class_name;
+    p.name = g.name;
+    p.poll = g.poll;
+    p.quiz = g.quiz;
+    p.started_us = g.results.empty() ? stopped_us : g.results[0].log().epoch_us();
+    p.stopped_us = stopped_us;
+    for (uint32_t i = 0; i < (uint32_t)s.student_ids.size(); ++i)
+        p.students.push_back({std::string(s.student_ids.id(i)), std::string(s.student_ids.first(i)), std::string(s.student_ids.last(i))});
+    p.questions.resize(g.results.size());
+    g_sdk.call([&] {
+        for (size_t i = 0; i < g.questions.size() && i < p.questions.size(); ++i) {
+            smartresponse_questionV1_t* question = g.questions[i];
+            SealedPoll::Question& q = p.questions[i];
+            q.type = smartresponse_questionV1_type(question);
+            q.points = smartresponse_questionV1_questionpoints(question);
+            q.text = sdk_string([&](char* b, int n) { return smartresponse_questionV1_questiontext(question, b, n); });
+            q.answer = sdk_string([&](char* b, int n) { return smartresponse_questionV1_answer(question, b, n); });
+            int choices = smartresponse_questionV1_choicecount(question);
+            for (int c = 0; c < choices; ++c)
+                q.choices.push_back(sdk_string([&](char* b, int n) { return smartresponse_questionV1_choicetext(question, c, b, n); }));
+        }
+    });
+    for (size_t i = 0; i < g.results.size(); ++i) {
+        const QuestionResults& r = g.results[i];
+        SealedPoll::Question& q = p.questions[i];
+        q.scored = r.marks().scored();
+        const LatestAnswers& latest = r.latest();
+        for (uint32_t st = 0; st < (uint32_t)latest.size(); ++st) {
+            if (latest.get(st) == LatestAnswers::kNone) continue;
+            q.students.push_back(st);
+            q.answers.push_back(latest.get(st));
+            q.times.push_back(latest.t_ms(st));
+            if (q.scored && r.marks().mark(st) == ScoreBoard::kCorrect) ++q.correct;
+        }
+        for (uint32_t t = 0; t < (uint32_t)r.text().size(); ++t) q.text_answers.push_back(r.text().str(t));
+    }
+    g_archive.submit(std::move(p));
+}
+
+// Marks the running poll or quiz stopped, logs and archives it; stopping
+// it on the connection is up to the caller. Caller holds s.mutex.
+static void stop_group(Session& s) {
+    s.poll_active = s.quiz_active = false;
+    uint64_t stopped_us = now_us();
+    s.wal.append(kWalStop, stopped_us, WalFields());
+    seal_group(s, s.groups.back(), stopped_us);
+    publish_changes(s);
+}
+
+// One question of an archived poll. Counts come from the answer column
+// alone; ?answers=1 also reads the student and time columns.
+static void append_archived_question_json(std::string& json, const PollArchive& a, const ArchiveQuestion& q, bool answers) {
+    const uint32_t* codes = a.answers(q);
+    ChoiceTally tally;
+    tally.reset(q.type, q.choice_count);
+    tally.rebuild(codes, q.rows);
+    json += "{\"type\":";
+    append_json_string(json, question_type_name(q.type));
+    json += ",\"text\":";
+    append_json_string(json, a.str(q.text));
+    json += ",\"answer\":";
+    append_json_string(json, a.str(q.answer));
+    json += ",\"points\":";
+    append_number_json(json, q.points);
+    json += ",\"responses\":" + std::to_string(tally.responses()) + ",\"other\":" + std::to_string(tally.other()) + ",\"choices\":[";
+    for (int i = 0; i < tally.choice_count(); ++i) {
+        if (i) json += ",";
+        json += "{\"label\":";
+        append_json_string(json, a.decode(q, 1u << i));
+        json += ",\"text\":";
+        append_json_string(json, a.choice(q, i));
+        json += ",\"count\":" + std::to_string(tally.count(i)) + "}";
+    }
+    json += "]";
+    if (q.text_answers) {
+        std::vector<uint32_t> counts(q.text_answers);
+        for (uint32_t r = 0; r < q.rows; ++r) {
+            if ((codes[r] & kTextAnswer) && (codes[r] & ~kTextAnswer) < q.text_answers) ++counts[codes[r] & ~kTextAnswer];
+        }
+        std::vector<uint32_t> order;
+        for (uint32_t t = 0; t < q.text_answers; ++t) {
+            if (counts[t]) order.push_back(t);
+        }
+        size_t top = std::min(order.size(), kDefaultTextTop);
+        std::partial_sort(order.begin(), order.begin() + top, order.end(), [&](uint32_t x, uint32_t y) { return counts[x] > counts[y]; });
+        json += ",\"distinct\":" + std::to_string(order.size()) + ",\"top\":[";
+        for (size_t i = 0; i < top; ++i) {
+            if (i) json += ",";
+            json += "{\"answer\":";
+            append_json_string(json, a.text_answer(q, order[i]));
+            json += ",\"count\":" + std::to_string(counts[order[i]]) + "}";
+        }
+        json += "]";
+    }
+    if (q.scored) json += ",\"score\":{\"answered\":" + std::to_string(q.rows) + ",\"correct\":" + std::to_string(q.correct) + "}";
+    if (answers) {
+        const uint32_t* students = a.students(q);
+        const uint32_t* times = a.times(q);
+        uint32_t roster = a.header().students;
+        json += ",\"answers\":[";
+        for (uint32_t r = 0; r < q.rows; ++r) {
+            if (r) json += ",";
+            json += "{\"studentId\":";
+            append_json_string(json, students[r] < roster ? a.str(a.student(students[r]).id) : std::string_view());
+            json += ",\"answer\":";
+            append_json_string(json, a.decode(q, codes[r]));
+            json += ",\"ms\":" + std::to_string(times[r]) + "}";
+        }
+        json += "]";
+    }
+    json += "}";
+}
+
+// --- Poll history ---
+// /history lists archived polls from g_history's time and class indexes;
+// see poll_history.h. Cursors are "<startedUs>.<id>" of the last poll of a
+// page.
+static constexpr size_t kHistoryPage = 50;
+static constexpr size_t kMaxHistoryPage = 500;
+
+static std::string history_cursor(const PollHistory::Cursor& c) {
+    return std::to_string(c.started_us) + "." + std::to_string(c.id);
+}
+
+static bool parse_history_cursor(const std::string& text, PollHistory::Cursor& c) {
+    size_t dot = text.find('.');
+    if (dot == std::string::npos) return false;
+    try {
+        size_t used = 0;
+        c.started_us = std::stoull(text.substr(0, dot), &used);
+        if (used != dot) return false;
+        c.id = std::stoull(text.substr(dot + 1), &used);
+        return used == text.size() - dot - 1;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+static void append_history_entry_json(std::string& json, const ArchiveIndexEntry& e) {
+    json += "{\"id\":" + std::to_string(e.id) + ",\"session\":";
+    append_json_string(json, std::string_view(e.session, strnlen(e.session, sizeof(e.session))));
+    json += ",\"class\":";
+    append_json_string(json, std::string_view(e.class_name, strnlen(e.class_name, sizeof(e.class_name))));
+    json += std::string(",\"") + (e.quiz ? "quiz" : "poll") + "\":" + std::to_string(e.poll) + ",\"startedUs\":" +
+            std::to_string(e.started_us) + ",\"stoppedUs\":" + std::to_string(e.stopped_us) + ",\"questions\":" +
+            std::to_string(e.questions) + ",\"responses\":" + std::to_string(e.rows) + ",\"students\":" +
+            std::to_string(e.students) + "}";
+}
+
+// Tallies summed over every poll in q's range, per question type.
+static void append_history_aggregate_json(std::string& json, const PollHistory::Query& q) {
+    struct TypeTotals {
+        int type = 0;
+        int choices = 0;
+        uint64_t questions = 0, responses = 0, other = 0;
+        uint64_t counts[ChoiceTally::kMaxChoices] = {};
+    };
+    std::vector<TypeTotals> types;
+    uint64_t polls = 0, questions = 0, responses = 0, answered = 0, correct = 0;
+    g_history.aggregate(q, [&](const ArchiveIndexEntry&, const std::vector<PollHistory::QuestionSummary>& summary) {
+        ++polls;
+        for (const auto& qs : summary) {
+            ++questions;
+            responses += qs.responses;
+            if (qs.scored) {
+                answered += qs.responses;
+                correct += qs.correct;
+            }
+            auto t = std::find_if(types.begin(), types.end(), [&](const TypeTotals& tt) { return tt.type == qs.type; });
+            if (t == types.end()) {
+                types.emplace_back();
+                t = types.end() - 1;
+                t->type = qs.type;
+            }
+            ++t->questions;
+            t->responses += qs.responses;
+            t->other += qs.other;
+            t->choices = std::max(t->choices, qs.choices);
+            for (int c = 0; c < qs.choices; ++c) t->counts[c] += qs.counts[c];
+        }
+    });
+    json += ",\"aggregate\":{\"polls\":" + std::to_string(polls) + ",\"questions\":" + std::to_string(questions) +
+            ",\"responses\":" + std::to_string(responses) + ",\"score\":{\"answered\":" + std::to_string(answered) +
+            ",\"correct\":" + std::to_string(correct) + ",\"percentCorrect\":";
+    if (answered) append_number_json(json, 100.0 * (double)correct / (double)answered);
+    else json += "null";
+    json += "},\"types\":[";
+    const StringTable no_text;
+    for (size_t i = 0; i < types.size(); ++i) {
+        const TypeTotals& t = types[i];
+        if (i) json += ",";
+        json += "{\"type\":";
+        append_json_string(json, question_type_name(t.type));
+        json += ",\"questions\":" + std::to_string(t.questions) + ",\"responses\":" + std::to_string(t.responses) +
+                ",\"other\":" + std::to_string(t.other) + ",\"choices\":[";
+        for (int c = 0; c < t.choices; ++c) {
+            if (c) json += ",";
+            json += "{\"label\":";
+            append_json_string(json, decode_answer(t.type, 1u << c, no_text));
+            json += ",\"count\":" + std::to_string(t.counts[c]) + "}";
+        }
+        json += "]}";
+    }
+    json += "]}";
+}
+
+// --- Live result stream (Server-Sent Events) ---
+// Each wakeup sends one "response" event per answer change since the
+// client's cursor followed by a single "summary" event, so a burst of
+// responses costs one tally serialization per stream rather than one per
+// response. Summaries are additionally throttled to kStreamInterval.
+static constexpr auto kStreamInterval = std::chrono::milliseconds(100);
+static constexpr auto kStreamKeepalive = std::chrono::seconds(15);
+
+struct StreamCursor {
+    uint64_t seq = 0;
+    uint64_t version = ~0ull;   // forces the initial state to be sent
+    uint16_t poll = 0;
+    std::chrono::steady_clock::time_point last_send;
+};
+
+static bool write_stream_events(Session& s, StreamCursor& c, httplib::DataSink& sink) {
+    uint64_t version = s.changes.wait_for_change(c.version, kStreamKeepalive);
+    if (s.closed) return false;
+    if (version == c.version) {
+        static const char kKeepalive[] = ": keepalive\n\n";
+        return sink.write(kKeepalive, sizeof(kKeepalive) - 1);
+    }
+    auto next = c.last_send + kStreamInterval;
+    if (std::chrono::steady_clock::now() < next) std::this_thread::sleep_until(next);
+    c.version = s.changes.version();
+
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        QuestionGroup* g = latest_group(s, false);
+        const QuestionResults& q = poll_results(g);
+        uint16_t poll = g ? g->poll : 0;
+        if (c.poll != poll) {
+            c.poll = poll;
+            out += "event: poll\ndata: {\"poll\":" + std::to_string(poll) + ",\"active\":" +
+                   (s.poll_active ? "true" : "false") + "}\n\n";
+        }
+        q.for_each_change_since(c.seq, [&](uint32_t student, uint32_t answer, uint64_t seq) {
+            out += "id: " + std::to_string(seq) + "\nevent: response\ndata: ";
+            append_result_json(s, out, q, student, answer, seq);
+            out += "\n\n";
+        });
+        c.seq = std::max(c.seq, s.seq);
+        out += "event: summary\ndata: ";
+        append_summary_json(out, q);
+        out += "\n\n";
+    }
+    c.last_send = std::chrono::steady_clock::now();
+    return sink.write(out.data(), out.size());
+}
+
+// --- Session lifecycle ---
+// Whether applying a log record calls the SDK (builds a class, student or
+// question), and so must run on the SDK dispatcher.
+static bool wal_record_uses_sdk(uint8_t type) {
+    return type == kWalClass || type == kWalStudent || type == kWalRemove || type == kWalGroup;
+}
+
+// Applies one log record; false if it does not fit the state rebuilt so
+// far. Records that use the SDK run on the dispatcher (see replay_wal).
+static bool apply_wal_record(Session& s, const WalReader::Record& r, std::string& error) {
+    WalFieldReader f(r.fields);
+    uint64_t index = 0, poll = 0, question = 0, flag = 0;
+    std::string text;
+    bool ok = true;
+    switch (r.type) {
+    case kWalClass:
+        ok = f.string(text);
+        if (ok) reset_class(s, text, 0);
+        break;
+    case kWalStudent: {
+        RosterStudent st;
+        ok = f.varint(index) && f.string(st.id) && f.string(st.first) && f.string(st.last) && s.sdk_class &&
+             add_roster_student(s, st) && s.student_ids.find(st.id) == index;
+        break;
+    }
+    case kWalRemove:
+        ok = f.varint(index) && index < s.students.size();
+        if (ok && on_roster(s, (uint32_t)index)) remove_roster_student(s, (uint32_t)index, false);
+        break;
+    case kWalClicker:
+        ok = f.varint(index) && f.string(text) && s.student_ids.intern(text) == index;
+        break;
+    case kWalGroup: {
+        ok = f.varint(flag) && f.string(text);
+        QuestionGroup* g = ok ? open_group(s, flag != 0, text, r.at_us, error) : nullptr;
+        ok = g != nullptr;
+        if (ok) (flag ? s.quiz_active : s.poll_active) = true;
+        if (ok)
+            for (auto& q : g->results) q.defer_tally(true);
+        break;
+    }
+    case kWalStop:
+        s.poll_active = s.quiz_active = false;
+        break;
+    case kWalCounters:
+        ok = f.varint(index) && f.varint(question);
+        s.question_index = (uint16_t)index;
+        s.seq = question;
+        break;
+    case kWalTotals: {
+        double possible = 0;
+        ok = f.number(possible) && f.varint(index) && index <= s.student_ids.size();
+        std::vector<double> points(ok ? (size_t)index : 0);
+        for (auto& p : points) ok = ok && f.number(p);
+        if (ok) s.score_totals.assign(std::move(points), possible);
+        break;
+    }
+    case kWalKey: {
+        double points = 0;
+        ok = f.varint(poll) && f.string(text) && f.number(points);
+        QuestionGroup* g = ok ? find_group(s, (uint16_t)poll) : nullptr;
+        if (g && !g->quiz) ok = set_poll_answer(s, *g, text, points, error);
+        break;
+    }
+    case kWalResponse: {
+        ok = f.varint(index) && f.varint(poll) && f.varint(question) && f.string(text) && index < s.student_ids.size();
+        QuestionGroup* g = ok ? find_group(s, (uint16_t)poll) : nullptr;
+        if (!g || question >= g->results.size()) break;   // expired since
+        RawResponse raw;
+        snprintf(raw.answer, sizeof(raw.answer), "%s", text.c_str());
+        raw.received_us = r.at_us;
+        raw.poll = (uint16_t)poll;
+        apply_response(s, *g, g->results[question], (uint32_t)index, raw);
+        break;
+    }
+    default:
+        ok = false;
+    }
+    return ok;
+}
+
+// Applies a session's log records in order. Runs before the session is
+// shared or connected, so it takes no lock; the log stays closed, so
+// nothing is logged twice. Runs of records that use the SDK are handed to
+// the dispatcher together, up to kReplaySdkBatch per call, so a long roster
+// neither costs a hand-off per student nor holds the dispatcher. Stops
+// at the first record that does not fit the state rebuilt so far. Choice
+// tallies are rebuilt once at the end rather than moved by every replayed
+// answer change.
+static constexpr size_t kReplaySdkBatch = 256;
+
+static bool replay_wal(Session& s, WalReader& log, std::string& error) {
+    WalReader::Record r;
+    uint64_t applied = 0;
+    bool ok = true;
+    bool more = log.next(r);
+    auto apply = [&] {
+        ok = apply_wal_record(s, r, error);
+        if (!ok) {
+            error = "record " + std::to_string(applied + 1) + " (type " + std::to_string(r.type) + ") does not apply" +
+                    (error.empty() ? "" : ": " + error);
+            return;
+        }
+        ++applied;
+        more = log.next(r);
+    };
+    while (ok && more) {
+        if (!wal_record_uses_sdk(r.type)) {
+            apply();
+            continue;
+        }
+        g_sdk.call([&] {
+            size_t n = 0;
+            do {
+                apply();
+            } while (ok && more && wal_record_uses_sdk(r.type) && ++n < kReplaySdkBatch);
+        });
+    }
+    for (auto& g : s.groups) {
+        for (auto& q : g.results) {
+            q.defer_tally(false);
+            q.refresh_extremes();
+        }
+    }
+    publish_changes(s);
+    return error.empty();
+}
+
+// --- Snapshots ---
+// Every kSnapshotInterval, or sooner once kSnapshotRecords have been logged,
+// the ingest thread rewrites the session log as a snapshot: the fewest
+// records that rebuild the current state, followed by the records logged
+// from then on. A snapshot holds the roster; each retained poll and quiz
+// with its body, answer key and every student's latest answer at its
+// original time; the counters, set so that replaying it numbers the
+// current poll's answers as before; and the banked score totals. Earlier
+// answer changes are not kept, so a restored poll's change log starts at
+// the snapshot. Restart time follows the size of that state and of the
+// tail, not how long the session has run.
+static constexpr auto kSnapshotInterval = std::chrono::seconds(60);
+static constexpr uint64_t kSnapshotRecords = 50000;
+
+// The image's last record is timed end_us, the log's last timestamp, so
+// records appended to the log afterwards can follow either. Caller holds
+// s.mutex.
+static std::string snapshot_image(Session& s, uint64_t end_us) {
+    std::string out(kWalMagic, sizeof(kWalMagic)), scratch;
+    uint64_t at = now_us(), last_us = 0;
+    auto put = [&](WalRecordType type, uint64_t at_us, const WalFields& f) { wal_encode(out, scratch, last_us, (uint8_t)type, at_us, f); };
+    if (s.sdk_class) put(kWalClass, at, WalFields().string(s.class_name));
+    for (uint32_t i = 0; i < (uint32_t)s.student_ids.size(); ++i) {
+        if (on_roster(s, i)) put(kWalStudent, at, WalFields().varint(i).string(s.student_ids.id(i)).string(s.student_ids.first(i)).string(s.student_ids.last(i)));
+        else put(kWalClicker, at, WalFields().varint(i).string(s.student_ids.id(i)));
+    }
+    // Answers to each group are replayed while it is the latest, and each
+    // counts as one change, so start seq where replaying them ends at s.seq.
+    uint64_t answers = 0;
+    for (const auto& g : s.groups)
+        for (const auto& q : g.results) answers += q.latest().answered();
+    if (!s.groups.empty()) put(kWalCounters, at, WalFields().varint(s.groups.front().poll - 1u).varint(s.seq > answers ? s.seq - answers : 0));
+    for (const auto& g : s.groups) {
+        uint64_t epoch = g.results[0].log().epoch_us();
+        put(kWalGroup, epoch, WalFields().varint(g.quiz).string(g.body));
+        for (uint32_t qi = 0; qi < (uint32_t)g.results.size(); ++qi) {
+            const QuestionResults& q = g.results[qi];
+            for (uint32_t st = 0; st < (uint32_t)q.latest().size(); ++st) {
+                uint32_t answer = q.latest().get(st);
+                if (answer == LatestAnswers::kNone) continue;
+                put(kWalResponse, epoch + q.latest().t_ms(st) * 1000ull, WalFields().varint(st).varint(g.poll).varint(qi).string(q.decode(answer)));
+            }
+        }
+        if (g.keyed) put(kWalKey, at, WalFields().varint(g.poll).string(g.key).number(g.key_points));
+        if (&g != &s.groups.back() || (!s.poll_active && !s.quiz_active)) put(kWalStop, at, WalFields());
+    }
+    WalFields totals;
+    totals.number(s.score_totals.possible()).varint(s.score_totals.size());
+    for (uint32_t i = 0; i < (uint32_t)s.score_totals.size(); ++i) totals.number(s.score_totals.points(i));
+    put(kWalTotals, end_us, totals);
+    return out;
 }
 
-// --- Helper: Create class and students from JSON ---
-#include <nlohmann/json.hpp>
-using json = nlohmann::json;
+// Replaces the session log with a snapshot and keeps appending after it.
+// Only the image is taken under s.mutex; it is written and synced, and the
+// log replaced (see WalWriter::replace), while ingestion and handlers carry
+// on. A crash leaves either log whole. Called by the ingest thread.
+static bool write_snapshot(Session& s, std::string& error) {
+    std::string image;
+    uint64_t appended;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        appended = s.wal.appended();
+        image = snapshot_image(s, s.wal.start_tail());
+    }
+    std::string tmp = s.wal_path + ".new";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    bool ok = f && std::fwrite(image.data(), 1, image.size(), f) == image.size() && std::fflush(f) == 0 && sync_file(f);
+    if (f && std::fclose(f) != 0) ok = false;
+    if (!ok) {
+        error = "cannot write " + tmp;
+        s.wal.stop_tail();
+    } else {
+        ok = s.wal.replace(tmp, s.wal_path, error);
+    }
+    if (!ok) {
+        std::error_code ec;
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    s.snapshot_at = std::chrono::steady_clock::now();
+    s.snapshot_appended = appended;
+    return true;
+}
 
-bool setup_class_and_students_from_json(const std::string& body, std::string& error) {
-    std::lock_guard<std::mutex> lock(g_mutex);
-    // Cleanup previous class/students
-    for (auto stu : g_students) sr_student_release(stu);
-    g_students.clear();
-    if (g_class) { sr_class_release(g_class); g_class = nullptr; }
+// Writes a snapshot once one is due; called by the ingest thread.
+static void maybe_write_snapshot(Session& s) {
+    uint64_t since = s.wal.appended() - s.snapshot_appended;
+    if (!since || (since < kSnapshotRecords && std::chrono::steady_clock::now() - s.snapshot_at < kSnapshotInterval)) return;
+    auto started = std::chrono::steady_clock::now();
+    std::string error;
+    if (!write_snapshot(s, error)) {
+        // Retry after another interval rather than on every wakeup.
+        s.snapshot_at = std::chrono::steady_clock::now();
+        s.snapshot_appended = s.wal.appended();
+        std::cerr << "Session " << s.id << ": snapshot failed, " << error << std::endl;
+        return;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+    std::cerr << "Session " << s.id << ": wrote snapshot after " << since << " log record(s) in " << ms << " ms" << std::endl;
+}
 
-    try {
-        auto j = json::parse(body);
-        if (!j.contains("className") || !j.contains("students")) {
-            error = "Missing className or students";
-            return false;
+// Rebuilds a session from <data dir>/<id>.wal, if there is one, and opens
+// the log for appending. A torn tail left by a crash is cut off, and so is
+// the log from a record that does not apply onwards, since records
+// appended after it would never be replayed. A poll or quiz that was
+// running is running again: the ingest thread reissues it once the new
+// connection is up.
+static bool restore_session(Session& s, std::string& error) {
+    auto started = std::chrono::steady_clock::now();
+    s.wal_path = (std::filesystem::path(g_data_dir) / (s.id + ".wal")).string();
+    WalReader log;
+    if (!log.open(s.wal_path, error)) return false;
+    if (log.records()) {
+        std::string replay_error;
+        if (!replay_wal(s, log, replay_error)) {
+            std::cerr << "Session " << s.id << ": replay stopped, " << replay_error << std::endl;
+            log.cut();
         }
-        std::string cname = j["className"];
-        if (cname.empty() || cname.size() > 8) {
-            error = "Class name must be 1-8 chars";
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+        std::cerr << "Session " << s.id << ": replayed " << log.records() << " log record(s) (" << log.size() << " bytes) in " << ms
+                  << " ms, " << s.roster_size << " student(s), " << s.groups.size() << " poll(s)/quiz(zes)" << std::endl;
+    }
+    if (log.valid_size() < log.size()) {
+        std::cerr << "Session " << s.id << ": dropping " << (log.size() - log.valid_size()) << " byte(s) of log tail" << std::endl;
+        std::error_code ec;
+        std::filesystem::resize_file(s.wal_path, log.valid_size(), ec);
+        if (ec) {
+            error = "Cannot truncate " + s.wal_path + ": " + ec.message();
             return false;
         }
-        g_class = sr_class_create((char*)cname.c_str(), (int)cname.size(), false);
-        for (const auto& stu : j["students"]) {
-            std::string last = stu.value("last", "");
-            std::string first = stu.value("first", "");
-            std::string id = stu.value("id", "");
-            if (last.empty() || first.empty() || id.empty()) continue;
-            sr_student_t* s = sr_student_create(last.c_str(), (int)last.size(), first.c_str(), (int)first.size(), id.c_str(), (int)id.size());
-            if (sr_class_addstudent(g_class, s) == SR::OK) {
-                g_students.push_back(s);
-            } else {
-                sr_student_release(s);
-            }
-        }
-        if (g_students.empty()) {
-            error = "No valid students";
+    }
+    if (!s.wal.open(s.wal_path, log.last_us(), error)) return false;
+    s.snapshot_at = std::chrono::steady_clock::now();
+    if (s.poll_active || s.quiz_active) s.link.resume_on_connect();
+    return true;
+}
+
+// Creates a session with its own SDK connection and ingest thread, first
+// restoring it from its log. The listeners are bound once, with the
+// session as their context. Connecting is asynchronous: the session is
+// usable at once, and requests that need the connection wait for it (see
+// await_connection).
+static std::shared_ptr<Session> open_session(const std::string& id, std::string& error) {
+    auto s = std::make_shared<Session>();
+    s->id = id;
+    if (!g_data_dir.empty() && !restore_session(*s, error)) return nullptr;
+    Session* raw = s.get();
+    bool created = g_sdk.call([raw] {
+        raw->connection = smartresponse_connectionV1_create(SMARTRESPONSE_INVOKE_CALLBACKS_ON_MAIN_THREAD_ONLY);
+        if (!raw->connection) return false;
+        raw->responded_listener = smartresponse_connectionV1_listenonclickerresponded(raw->connection, on_student_responded, raw);
+        raw->connected_listener = smartresponse_connectionV1_listenonconnected(raw->connection, on_connected, raw);
+        raw->failed_listener = smartresponse_connectionV1_listenonconnectiondidfail(raw->connection, on_connection_failed, raw);
+        raw->disconnected_listener = smartresponse_connectionV1_listenondisconnected(raw->connection, on_disconnected, raw);
+        raw->link.connecting();
+        smartresponse_connectionV1_connect(raw->connection);
+        return true;
+    });
+    if (!created) {
+        error = "Failed to create SDK connection";
+        return nullptr;
+    }
+    start_ingest(*s);
+    return s;
+}
+
+// Stops callbacks first, so nothing reaches the session while it is torn
+// down. Commands the ingest thread posted run before the final release.
+Session::~Session() {
+    replay.stop();
+    g_sdk.call([this] {
+        for (auto l : {responded_listener, connected_listener, failed_listener, disconnected_listener})
+            if (l) smartresponse_listener_release(l);
+    });
+    stop_ingest(*this);
+    g_sdk.call([this] {
+        for (auto& g : groups) release_group(g);
+        for (auto stu : students) if (stu) sr_student_release(stu);
+        if (sdk_class) sr_class_release(sdk_class);
+        if (connection) smartresponse_connectionV1_release(connection);
+    });
+    wal.close();
+    if (closed && !wal_path.empty()) std::remove(wal_path.c_str());
+}
+
+static std::shared_ptr<Session> find_session(const std::string& id) {
+    std::lock_guard<std::mutex> lock(g_sessions_mutex);
+    auto it = g_sessions.find(id);
+    return it == g_sessions.end() ? nullptr : it->second;
+}
+
+// Session ids appear in URLs: 1-32 letters, digits, '-' or '_'.
+static bool valid_session_id(const std::string& id) {
+    if (id.empty() || id.size() > 32) return false;
+    for (char c : id)
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_') return false;
+    return true;
+}
+
+// How long a request waits for the SDK connection by default; ?wait=<ms>
+// overrides it up to kMaxReadyWait.
+static constexpr auto kReadyWait = std::chrono::milliseconds(5000);
+static constexpr auto kMaxReadyWait = std::chrono::milliseconds(30000);
+
+static void append_connection_json(std::string& json, const ConnectionState::Status& st) {
+    json += "\"state\":\"";
+    json += ConnectionState::name(st.state);
+    json += "\",\"attempts\":" + std::to_string(st.attempts) + ",\"reconnects\":" + std::to_string(st.reconnects);
+    if (st.state == ConnectionState::Disconnected || st.state == ConnectionState::Failed)
+        json += ",\"retryInMs\":" + std::to_string(st.retry_in_ms);
+    if (!st.error.empty()) {
+        json += ",\"error\":";
+        append_json_string(json, st.error);
+    }
+}
+
+// Waits for the session's SDK connection before a request that needs it.
+// Replies 503 with Retry-After if it is not up in time. Call before taking
+// s.mutex: the wait must not hold up ingestion.
+static bool await_connection(Session& s, const httplib::Request& req, httplib::Response& res) {
+    std::chrono::milliseconds wait = kReadyWait;
+    if (req.has_param("wait")) {
+        try {
+            wait = std::chrono::milliseconds(std::stoll(req.get_param_value("wait")));
+        } catch (const std::exception&) {
+            res.status = 400;
+            res.set_content("{\"error\":\"wait must be a number of milliseconds\"}", "application/json");
             return false;
         }
-        return true;
-    } catch (const std::exception& ex) {
-        error = ex.what();
-        return false;
+        wait = std::max(std::chrono::milliseconds(0), std::min(wait, kMaxReadyWait));
     }
+    if (s.link.wait_ready(wait)) return true;
+    ConnectionState::Status st = s.link.status();
+    std::string json = "{\"error\":\"SDK connection not ready\",";
+    append_connection_json(json, st);
+    json += "}";
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(std::max<int64_t>(1, (st.retry_in_ms + 999) / 1000)));
+    res.set_content(json, "application/json");
+    return false;
 }
 
-// --- Helper: Setup poll from JSON ---
-bool setup_poll_from_json(const std::string& body, std::string& error) {
-    std::lock_guard<std::mutex> lock(g_mutex);
-    if (g_question) { smartresponse_questionV1_release(g_question); g_question = nullptr; }
-    try {
-        auto j = json::parse(body);
-        std::string qtext = j.value("question", "");
-        std::string qtype = j.value("type", "multiplechoice");
-        auto choices = j.value("choices", std::vector<std::string>{});
-        std::string answer = j.value("answer", "");
-        int sdk_type = 0;
-        int choice_count = 0;
-        if (qtype == "multiplechoice") {
-            sdk_type = SMARTRESPONSE_QUESTIONTYPE_MULTIPLECHOICE;
-            choice_count = (int)choices.size();
-            if (choice_count < 2 || choice_count > 10) {
-                error = "Multiple choice: 2-10 choices required";
-                return false;
+// --- Response replay ---
+// POST /replay plays the responses recorded in a session log back into a
+// session through push_response, as on_student_responded does, so they
+// take the same ring, ingest and publish path as live clicker traffic.
+// Student ids are resolved from the roster and clicker records of the
+// same log, and events are played in recorded time order.
+//
+// By default each recorded response goes to the question at its recorded
+// position in whatever poll or quiz the target session is running. An
+// offline replay instead rebuilds each recorded poll and quiz from the
+// log's start records, with its answer keys and stop, without starting it
+// on the SDK, and sends each response to the one it was recorded for; it
+// needs no connection, only a session with nothing running. Either way
+// replayed polls and responses are applied and logged like any others, so
+// replay into a session set up for the run rather than a live room.
+//
+// A log compacted into a snapshot (see "Snapshots") keeps only each
+// student's latest answer to each retained poll: the changes before it,
+// and the bursts they made, are gone, and only the tail logged since
+// replays as recorded. /replay reports such a trace as "snapshot": true.
+
+// The events in log in recorded time order; events with the same time
+// keep their log order. A snapshot writes answers poll by poll and
+// question by question, and times its stops and keys as of when it was
+// taken, so its records are out of time order. Sets snapshot if the log
+// holds one.
+static std::vector<ReplayEvent> load_replay_trace(WalReader& log, bool& snapshot) {
+    std::vector<ReplayEvent> events;
+    std::vector<std::string> ids;       // student index -> id, as of this point in the log
+    uint16_t poll = 0;                  // number of the last poll or quiz started, as in the log
+    snapshot = false;
+    WalReader::Record r;
+    while (log.next(r)) {
+        WalFieldReader f(r.fields);
+        uint64_t index, number, qi;
+        std::string id, text;
+        ReplayEvent e;
+        e.at_us = r.at_us;
+        switch (r.type) {
+        case kWalClass:
+            ids.clear();
+            break;
+        case kWalStudent:
+        case kWalClicker:
+            // Indices are handed out densely, so a new one is always next.
+            if (f.varint(index) && f.string(id) && index <= ids.size()) {
+                if (index == ids.size()) ids.emplace_back();
+                ids[index] = id;
             }
-        } else if (qtype == "multipleanswer") {
-            sdk_type = SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER;
-            choice_count = (int)choices.size();
-            if (choice_count < 2 || choice_count > 10) {
-                error = "Multiple answer: 2-10 choices required";
-                return false;
+            break;
+        case kWalCounters:
+            snapshot = true;
+            if (f.varint(index)) poll = (uint16_t)index;
+            break;
+        case kWalTotals:
+            snapshot = true;
+            break;
+        case kWalGroup:
+            e.kind = ReplayEvent::kStart;
+            e.poll = ++poll;
+            if (f.varint(number) && f.string(e.answer)) {
+                e.quiz = number != 0;
+                events.push_back(std::move(e));
             }
-        } else if (qtype == "yesno") {
-            sdk_type = SMARTRESPONSE_QUESTIONTYPE_YESNO;
-            choice_count = 2;
-        } else if (qtype == "truefalse") {
-            sdk_type = SMARTRESPONSE_QUESTIONTYPE_TRUEFALSE;
-            choice_count = 2;
-        } else if (qtype == "decimal") {
-            sdk_type = SMARTRESPONSE_QUESTIONTYPE_DECIMAL;
-            choice_count = 0;
-        } else if (qtype == "fractional") {
-            sdk_type = SMARTRESPONSE_QUESTIONTYPE_FRACTIONAL;
-            choice_count = 0;
-        } else if (qtype == "shorttext") {
-            sdk_type = SMARTRESPONSE_QUESTIONTYPE_SHORTTEXT;
-            choice_count = 0;
-        } else {
-            error = "Unknown question type";
-            return false;
-        }
-        if (qtext.empty()) {
-            error = "Question text required";
-            return false;
-        }
-        g_question = smartresponse_questionV1_create(sdk_type, choice_count);
-        smartresponse_questionV1_setquestiontext(g_question, (char*)qtext.c_str(), -1);
-        if (sdk_type == SMARTRESPONSE_QUESTIONTYPE_MULTIPLECHOICE || sdk_type == SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER) {
-            for (size_t i = 0; i < choices.size(); ++i) {
-                smartresponse_questionV1_setchoicetext(g_question, (int)i, (char*)choices[i].c_str(), -1);
+            break;
+        case kWalStop:
+            e.kind = ReplayEvent::kStop;
+            e.poll = poll;
+            events.push_back(std::move(e));
+            break;
+        case kWalKey:
+            e.kind = ReplayEvent::kKey;
+            if (f.varint(number) && f.string(e.answer) && f.number(e.points)) {
+                e.poll = (uint16_t)number;
+                events.push_back(std::move(e));
             }
+            break;
+        case kWalResponse:
+            if (f.varint(index) && f.varint(number) && f.varint(qi) && f.string(e.answer) && index < ids.size()) {
+                e.poll = (uint16_t)number;
+                e.id = ids[index];
+                e.question_id = std::to_string(qi + 1);
+                events.push_back(std::move(e));
+            }
+            break;
+        default:
+            break;
         }
-        if (!answer.empty()) {
-            smartresponse_questionV1_setanswer(g_question, (char*)answer.c_str(), -1);
-        }
-        return true;
-    } catch (const std::exception& ex) {
-        error = ex.what();
-        return false;
     }
+    std::stable_sort(events.begin(), events.end(), [](const ReplayEvent& a, const ReplayEvent& b) { return a.at_us < b.at_us; });
+    return events;
 }
 
-// --- Helper: Cleanup ---
-void cleanup() {
-    if (g_question) { smartresponse_questionV1_release(g_question); g_question = nullptr; }
-    for (auto stu : g_students) sr_student_release(stu);
-    g_students.clear();
-    if (g_class) { sr_class_release(g_class); g_class = nullptr; }
-    if (g_connection) { smartresponse_connectionV1_release(g_connection); g_connection = nullptr; }
-    smartresponse_sdk_terminate();
+// Plays one event of an offline replay, on the replay thread. polls maps
+// recorded poll numbers to the ones rebuilt here. A start stops whatever
+// the replay left running; a stop applies only to the poll it was logged
+// for, if that is still the one running.
+static void replay_offline_event(Session& s, std::map<uint16_t, uint16_t>& polls, const ReplayEvent& e) {
+    auto it = polls.find(e.poll);
+    if (e.kind == ReplayEvent::kResponse) {
+        if (it != polls.end()) push_response(s, e.id.c_str(), e.question_id.c_str(), e.answer.c_str(), it->second);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::string error;
+    switch (e.kind) {
+    case ReplayEvent::kStart: {
+        if (s.poll_active || s.quiz_active) stop_group(s);
+        QuestionGroup* g = open_group(s, e.quiz, e.answer, now_us(), error);
+        if (!g) break;
+        polls[e.poll] = g->poll;
+        (e.quiz ? s.quiz_active : s.poll_active) = true;
+        publish_changes(s);
+        break;
+    }
+    case ReplayEvent::kStop:
+        if (it != polls.end() && (s.poll_active || s.quiz_active) && s.groups.back().poll == it->second) stop_group(s);
+        break;
+    case ReplayEvent::kKey: {
+        QuestionGroup* g = it != polls.end() ? find_group(s, it->second) : nullptr;
+        if (g && !g->quiz && set_poll_answer(s, *g, e.answer, e.points, error)) publish_changes(s);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void append_replay_json(Session& s, std::string& json) {
+    ResponseReplay::Status st = s.replay.status();
+    const LatencyHistogram& lat = s.ingest_latency;
+    uint64_t applied = lat.count();
+    uint64_t drops;
+    bool snapshot;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        drops = s.ring.dropped() - s.replay_drops;
+        snapshot = s.replay_snapshot;
+    }
+    json += "{\"running\":" + std::string(st.running ? "true" : "false") + ",\"events\":" + std::to_string(st.total) +
+            ",\"sent\":" + std::to_string(st.sent) + ",\"snapshot\":" + (snapshot ? "true" : "false") + ",\"speed\":";
+    if (st.speed > 0) append_number_json(json, st.speed);
+    else json += "\"max\"";
+    json += ",\"elapsedMs\":" + std::to_string(st.elapsed_us / 1000) + ",\"applied\":" + std::to_string(applied) +
+            ",\"dropped\":" + std::to_string(drops) + ",\"throughput\":";
+    // Applied responses per second, up to the last one published.
+    uint64_t span = lat.last_at_us() > st.started_us ? lat.last_at_us() - st.started_us : 0;
+    if (applied && span) append_number_json(json, (double)applied * 1e6 / (double)span);
+    else json += "null";
+    json += ",\"latencyUs\":{\"p50\":" + std::to_string(lat.quantile(0.5)) + ",\"p90\":" + std::to_string(lat.quantile(0.9)) +
+            ",\"p99\":" + std::to_string(lat.quantile(0.99)) + ",\"max\":" + std::to_string(lat.max()) + "}}";
+}
+
+// --- Per-session routing ---
+// Handlers take the session the request addresses: /sessions/{id}/... or,
+// for the unprefixed routes, the default session.
+using SessionHandler = std::function<void(Session&, const httplib::Request&, httplib::Response&)>;
+using SessionReaderHandler = std::function<void(Session&, const httplib::Request&, httplib::Response&, const httplib::ContentReader&)>;
+
+static std::shared_ptr<Session> request_session(const httplib::Request& req, httplib::Response& res) {
+    auto it = req.path_params.find("id");
+    std::shared_ptr<Session> s = find_session(it == req.path_params.end() ? kDefaultSession : it->second);
+    if (!s) {
+        res.status = 404;
+        res.set_content("{\"error\":\"No such session\"}", "application/json");
+    }
+    return s;
+}
+
+static httplib::Server::Handler in_session(SessionHandler handler) {
+    return [handler](const httplib::Request& req, httplib::Response& res) {
+        if (std::shared_ptr<Session> s = request_session(req, res)) handler(*s, req, res);
+    };
+}
+
+static httplib::Server::HandlerWithContentReader in_session(SessionReaderHandler handler) {
+    return [handler](const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& content) {
+        if (std::shared_ptr<Session> s = request_session(req, res)) handler(*s, req, res, content);
+    };
 }
 
 int main() {
@@ -154,80 +1972,826 @@ int main() {
         std::cerr << "Failed to initialize SMART Response SDK" << std::endl;
         return 1;
     }
-    g_connection = smartresponse_connectionV1_create(SMARTRESPONSE_INVOKE_CALLBACKS_ON_MAIN_THREAD_ONLY);
-    if (!g_connection) {
-        std::cerr << "Failed to create SDK connection" << std::endl;
-        smartresponse_sdk_terminate();
-        return 1;
+    g_sdk.start();
+
+    // --- Data directory ---
+    // Session logs live in $SR_DATA_DIR (default ./data); every session
+    // with a log there is restored. SR_DATA_DIR= (empty) turns logging off.
+    const char* data_dir = std::getenv("SR_DATA_DIR");
+    g_data_dir = data_dir ? data_dir : "data";
+    std::error_code ec;
+    if (!g_data_dir.empty() && !std::filesystem::create_directories(g_data_dir, ec) && ec) {
+        std::cerr << "Cannot create data directory " << g_data_dir << " (" << ec.message() << "); sessions will not be logged" << std::endl;
+        g_data_dir.clear();
+    }
+    if (!g_data_dir.empty()) {
+        std::string error;
+        g_archive.on_sealed([](const ArchiveIndexEntry& e) { g_history.add(e); });
+        if (!g_archive.open((std::filesystem::path(g_data_dir) / "archive").string(), error))
+            std::cerr << error << "; polls will not be archived" << std::endl;
+        else if (!g_history.open(g_archive.dir(), error))
+            std::cerr << error << "; archived polls before this run will not be listed" << std::endl;
+    }
+    std::vector<std::string> session_ids = {kDefaultSession};
+    if (!g_data_dir.empty()) {
+        for (const auto& entry : std::filesystem::directory_iterator(g_data_dir, ec)) {
+            std::string id = entry.path().stem().string();
+            if (entry.path().extension() == ".wal" && id != kDefaultSession && valid_session_id(id)) session_ids.push_back(id);
+        }
+    }
+    for (const auto& id : session_ids) {
+        if (g_sessions.size() >= kMaxSessions) {
+            std::cerr << "Session " << id << ": not restored, at most " << kMaxSessions << " sessions" << std::endl;
+            continue;
+        }
+        std::string error;
+        std::shared_ptr<Session> s = open_session(id, error);
+        if (!s && id == kDefaultSession) {
+            std::cerr << error << std::endl;
+            smartresponse_sdk_terminate();
+            return 1;
+        }
+        if (s) g_sessions[id] = std::move(s);
+        else std::cerr << "Session " << id << ": " << error << std::endl;
     }
-    // Connect (async, but we assume instant for demo)
-    smartresponse_connectionV1_connect(g_connection);
 
     httplib::Server svr;
+    // Stream and long-poll requests each park a worker thread, so size the
+    // pool for a room full of dashboards rather than for CPU count.
+    svr.new_task_queue = [] { return new httplib::ThreadPool(64); };
+
+    // Every session route is served at /sessions/:id<path> and, for the
+    // default session, at <path>.
+    auto get = [&](const std::string& path, SessionHandler h) {
+        svr.Get(path, in_session(h));
+        svr.Get("/sessions/:id" + path, in_session(h));
+    };
+    auto post = [&](const std::string& path, SessionHandler h) {
+        svr.Post(path, in_session(h));
+        svr.Post("/sessions/:id" + path, in_session(h));
+    };
+    auto put = [&](const std::string& path, SessionHandler h) {
+        svr.Put(path, in_session(h));
+        svr.Put("/sessions/:id" + path, in_session(h));
+    };
+    auto patch = [&](const std::string& path, SessionHandler h) {
+        svr.Patch(path, in_session(h));
+        svr.Patch("/sessions/:id" + path, in_session(h));
+    };
+
+    // --- Session registry endpoints ---
+    // {"id": "room-101"} opens a session with its own SDK connection.
+    svr.Post("/sessions", [](const httplib::Request& req, httplib::Response& res) {
+        std::string id;
+        try {
+            id = json::parse(req.body).value("id", "");
+        } catch (const std::exception& ex) {
+            res.status = 400;
+            res.set_content(error_json(ex.what()), "application/json");
+            return;
+        }
+        if (!valid_session_id(id)) {
+            res.status = 400;
+            res.set_content("{\"error\":\"Session id must be 1-32 letters, digits, '-' or '_'\"}", "application/json");
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(g_sessions_mutex);
+            if (g_sessions.count(id) || g_opening_sessions.count(id)) {
+                res.status = 409;
+                res.set_content("{\"error\":\"Session already exists\"}", "application/json");
+                return;
+            }
+            if (g_sessions.size() + g_opening_sessions.size() >= kMaxSessions) {
+                res.status = 400;
+                res.set_content("{\"error\":\"At most " + std::to_string(kMaxSessions) + " sessions\"}", "application/json");
+                return;
+            }
+            g_opening_sessions.insert(id);
+        }
+        // Restoring reads the session's log and calls the SDK, so the id is
+        // reserved and the registry left unlocked meanwhile.
+        std::string error;
+        std::shared_ptr<Session> s = open_session(id, error);
+        {
+            std::lock_guard<std::mutex> lock(g_sessions_mutex);
+            g_opening_sessions.erase(id);
+            if (s) g_sessions[id] = s;
+        }
+        if (!s) {
+            res.status = 500;
+            res.set_content(error_json(error), "application/json");
+            return;
+        }
+        res.status = 201;
+        res.set_content("{\"status\":\"session created\",\"id\":\"" + id + "\"}", "application/json");
+    });
+
+    svr.Get("/sessions", [](const httplib::Request& req, httplib::Response& res) {
+        std::vector<std::shared_ptr<Session>> sessions;
+        {
+            std::lock_guard<std::mutex> lock(g_sessions_mutex);
+            for (const auto& entry : g_sessions) sessions.push_back(entry.second);
+        }
+        std::string json = "{\"sessions\":[";
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            Session& s = *sessions[i];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (i) json += ",";
+            json += "{\"id\":";
+            append_json_string(json, s.id);
+            json += ",\"className\":";
+            append_json_string(json, s.class_name);
+            json += ",\"students\":" + std::to_string(s.roster_size) + ",\"pollActive\":" + (s.poll_active ? "true" : "false") +
+                    ",\"quizActive\":" + (s.quiz_active ? "true" : "false") + ",\"logFailing\":" +
+                    (s.wal.failing() ? "true" : "false") + ",\"connection\":\"" + ConnectionState::name(s.link.status().state) + "\"}";
+        }
+        json += "]}";
+        res.set_content(json, "application/json");
+    });
+
+    // Drops a session; its SDK connection is released once requests still
+    // using it finish, and its open streams end.
+    svr.Delete("/sessions/:id", [](const httplib::Request& req, httplib::Response& res) {
+        const std::string& id = req.path_params.at("id");
+        if (id == kDefaultSession) {
+            res.status = 400;
+            res.set_content("{\"error\":\"The default session cannot be deleted\"}", "application/json");
+            return;
+        }
+        std::shared_ptr<Session> s;
+        {
+            std::lock_guard<std::mutex> lock(g_sessions_mutex);
+            auto it = g_sessions.find(id);
+            if (it != g_sessions.end()) {
+                s = std::move(it->second);
+                g_sessions.erase(it);
+            }
+        }
+        if (!s) {
+            res.status = 404;
+            res.set_content("{\"error\":\"No such session\"}", "application/json");
+            return;
+        }
+        s->closed = true;
+        s->changes.publish();
+        res.set_content("{\"status\":\"session deleted\"}", "application/json");
+    });
+
+    // A sealed poll or quiz, by archive id: its question metadata and
+    // per-question counts, and with ?answers=1 every student's final answer
+    // and when it was given (ms after the start).
+    svr.Get("/archive/:id", [](const httplib::Request& req, httplib::Response& res) {
+        uint64_t id = 0;
+        try {
+            id = std::stoull(req.path_params.at("id"));
+        } catch (const std::exception&) {
+        }
+        PollArchive a;
+        std::string error;
+        if (!g_archive.is_open() || !id || !std::filesystem::exists(g_archive.path_of(id)) || !a.open(g_archive.path_of(id), error)) {
+            res.status = 404;
+            res.set_content("{\"error\":\"No such archived poll\"}", "application/json");
+            return;
+        }
+        bool answers = req.get_param_value("answers") == "1";
+        const ArchiveHeader& h = a.header();
+        std::string json = "{\"id\":" + std::to_string(id) + ",\"session\":";
+        append_json_string(json, a.str(h.session));
+        json += ",\"class\":";
+        append_json_string(json, a.str(h.class_name));
+        json += std::string(",\"") + (h.quiz ? "quiz" : "poll") + "\":" + std::to_string(h.poll);
+        if (h.quiz) {
+            json += ",\"name\":";
+            append_json_string(json, a.str(h.name));
+        }
+        json += ",\"startedUs\":" + std::to_string(h.started_us) + ",\"stoppedUs\":" + std::to_string(h.stopped_us) +
+                ",\"students\":" + std::to_string(h.students) + ",\"questions\":[";
+        for (uint32_t i = 0; i < h.questions; ++i) {
+            if (i) json += ",";
+            append_archived_question_json(json, a, a.question(i), answers);
+        }
+        json += "]}";
+        res.set_content(json, "application/json");
+    });
+
+    // Archived polls, oldest first: ?class=<name> and ?session=<id> filter,
+    // ?from= / ?to= bound the start time (us since the epoch, to exclusive),
+    // ?limit= sizes the page and ?cursor= continues after the previous one
+    // ("next" in its reply, null on the last page). ?aggregate=1 adds
+    // tallies summed over the whole range, not just the page.
+    svr.Get("/history", [](const httplib::Request& req, httplib::Response& res) {
+        PollHistory::Query q;
+        q.by_class = req.has_param("class");
+        q.class_name = req.get_param_value("class");
+        q.session = req.get_param_value("session");
+        size_t limit = kHistoryPage;
+        try {
+            if (req.has_param("from")) q.from_us = std::stoull(req.get_param_value("from"));
+            if (req.has_param("to")) q.to_us = std::stoull(req.get_param_value("to"));
+            if (req.has_param("limit")) limit = std::min<size_t>(std::max<size_t>(std::stoul(req.get_param_value("limit")), 1), kMaxHistoryPage);
+        } catch (const std::exception&) {
+            res.status = 400;
+            res.set_content("{\"error\":\"from, to and limit must be numbers\"}", "application/json");
+            return;
+        }
+        q.after_cursor = req.has_param("cursor");
+        if (q.after_cursor && !parse_history_cursor(req.get_param_value("cursor"), q.after)) {
+            res.status = 400;
+            res.set_content("{\"error\":\"Invalid cursor\"}", "application/json");
+            return;
+        }
+        std::string json = "{\"polls\":[";
+        bool first = true;
+        PollHistory::Cursor next;
+        bool more = g_history.scan(q, limit, [&](const ArchiveIndexEntry& e) {
+            if (!first) json += ",";
+            first = false;
+            append_history_entry_json(json, e);
+        }, next);
+        json += "],\"next\":";
+        if (more) append_json_string(json, history_cursor(next));
+        else json += "null";
+        if (req.get_param_value("aggregate") == "1") append_history_aggregate_json(json, q);
+        json += "}";
+        res.set_content(json, "application/json");
+    });
+
+    // 200 once the session's SDK connection is up, 503 while it is
+    // connecting or waiting to retry; both report the connection state.
+    get("/health/ready", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        ConnectionState::Status st = s.link.status();
+        bool ready = st.state == ConnectionState::Connected;
+        std::string json = std::string("{\"ready\":") + (ready ? "true," : "false,");
+        append_connection_json(json, st);
+        json += "}";
+        if (!ready) res.status = 503;
+        res.set_content(json, "application/json");
+    });
 
     // --- Setup class/students endpoint ---
-    svr.Post("/class/setup", [](const httplib::Request& req, httplib::Response& res) {
+    post("/class/setup", [](Session& s, const httplib::Request& req, httplib::Response& res) {
         std::string error;
-        if (!setup_class_and_students_from_json(req.body, error)) {
+        if (!setup_class_and_students_from_json(s, req.body, error)) {
             res.status = 400;
-            res.set_content(std::string("{\"error\":\"") + error + "\"}", "application/json");
+            res.set_content(error_json(error), "application/json");
             return;
         }
         res.set_content("{\"status\":\"class setup complete\"}", "application/json");
     });
 
-    svr.Post("/poll/start", [](const httplib::Request& req, httplib::Response& res) {
-        std::lock_guard<std::mutex> lock(g_mutex);
-        if (g_poll_active) {
+    post("/poll/start", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        if (!await_connection(s, req, res)) return;
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.poll_active) {
             res.set_content("{\"status\":\"already running\"}", "application/json");
             return;
         }
-        if (!g_class || g_students.empty()) {
+        if (s.quiz_active) {
+            res.status = 400;
+            res.set_content("{\"error\":\"A quiz is running. Use /quiz/stop first.\"}", "application/json");
+            return;
+        }
+        if (!s.sdk_class || !s.roster_size) {
             res.status = 400;
             res.set_content("{\"error\":\"No class/students setup. Use /class/setup first.\"}", "application/json");
             return;
         }
         std::string error;
-        if (!setup_poll_from_json(req.body, error)) {
+        QuestionGroup* g = open_group(s, false, req.body, now_us(), error);
+        if (!g) {
             res.status = 400;
-            res.set_content(std::string("{\"error\":\"") + error + "\"}", "application/json");
+            res.set_content(error_json(error), "application/json");
             return;
         }
-        // Start the class
-        smartresponse_connectionV2_startclass(g_connection, g_class);
-        // Listen for responses
-        smartresponse_connectionV1_listenonclickerresponded(g_connection, on_student_responded, nullptr);
-        // Start the question
-        smartresponse_connectionV1_startquestion(g_connection, g_question);
-        g_results.clear();
-        g_poll_active = true;
-        res.set_content("{\"status\":\"poll started\"}", "application/json");
+        g_sdk.call([&] {
+            smartresponse_connectionV2_startclass(s.connection, s.sdk_class);
+            smartresponse_connectionV1_startquestion(s.connection, g->questions[0]);
+        });
+        s.poll_active = true;
+        publish_changes(s);
+        res.set_content("{\"status\":\"poll started\",\"poll\":" + std::to_string(g->poll) + "}", "application/json");
     });
 
-    svr.Post("/poll/stop", [](const httplib::Request& req, httplib::Response& res) {
-        std::lock_guard<std::mutex> lock(g_mutex);
-        if (!g_poll_active) {
+    post("/poll/stop", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        if (!await_connection(s, req, res)) return;
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.poll_active) {
             res.set_content("{\"status\":\"no poll running\"}", "application/json");
             return;
         }
-        smartresponse_connectionV1_stopquestion(g_connection);
-        g_poll_active = false;
+        g_sdk.call([&] { smartresponse_connectionV1_stopquestion(s.connection); });
+        stop_group(s);
         res.set_content("{\"status\":\"poll stopped\"}", "application/json");
     });
 
-    svr.Get("/poll/results", [](const httplib::Request& req, httplib::Response& res) {
-        std::lock_guard<std::mutex> lock(g_mutex);
-        std::string json = "{\"results\":[";
-        for (size_t i = 0; i < g_results.size(); ++i) {
-            json += g_results[i];
-            if (i + 1 < g_results.size()) json += ",";
+    // Replaces the answer key (and optionally the points) of the current or
+    // last poll, or of ?poll=<n>: {"answer": "B", "points": 2}. Current
+    // answers are rescored in place, banked points included; an empty
+    // answer makes the poll unscored.
+    put("/poll/answer", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        QuestionGroup* g;
+        if (!find_group_param(s, req, res, false, g)) return;
+        if (!g) {
+            res.status = 400;
+            res.set_content("{\"error\":\"No poll. Use /poll/start first.\"}", "application/json");
+            return;
+        }
+        std::string error, answer;
+        double points = g->results[0].config().points;
+        try {
+            auto j = json::parse(req.body);
+            answer = j.value("answer", "");
+            points = j.value("points", points);
+        } catch (const std::exception& ex) {
+            res.status = 400;
+            res.set_content(error_json(ex.what()), "application/json");
+            return;
+        }
+        if (!set_poll_answer(s, *g, answer, points, error)) {
+            res.status = 400;
+            res.set_content(error_json(error), "application/json");
+            return;
+        }
+        publish_changes(s);
+        res.set_content("{\"status\":\"answer key updated\"}", "application/json");
+    });
+
+    // Per-student points against the answer keys of every poll and quiz
+    // since the class was set up, and each student's mark on the latest poll.
+    get("/poll/scores", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        QuestionGroup* poll = latest_group(s, false);
+        const ScoreBoard& marks = poll_results(poll).marks();
+        // The current group is not banked yet.
+        QuestionGroup* current = s.groups.empty() || s.groups.back().banked ? nullptr : &s.groups.back();
+        double possible = s.score_totals.possible();
+        if (current)
+            for (const auto& q : current->results)
+                if (q.marks().scored()) possible += q.marks().points();
+        std::string json = "{\"poll\":" + std::to_string(poll ? poll->poll : 0) + ",\"scored\":" + (marks.scored() ? "true" : "false") +
+                           ",\"possible\":";
+        append_number_json(json, possible);
+        json += ",\"students\":[";
+        for (uint32_t i = 0; i < (uint32_t)s.student_ids.size(); ++i) {
+            if (i) json += ",";
+            json += "{\"studentId\":";
+            append_json_string(json, s.student_ids.id(i));
+            json += ",\"correct\":";
+            ScoreBoard::Mark mark = marks.mark(i);
+            json += !marks.scored() || mark == ScoreBoard::kUnanswered ? "null" : mark == ScoreBoard::kCorrect ? "true" : "false";
+            json += ",\"score\":";
+            double score = s.score_totals.points(i);
+            if (current && i < current->students.size()) score += current->students[i].score;
+            append_number_json(json, score);
+            json += "}";
+        }
+        json += "]}";
+        res.set_content(json, "application/json");
+    });
+
+    // Roster in dense-index order, including clickers that answered without
+    // being on the roster and removed students ("roster": false).
+    // Adds and removes students without touching anyone else:
+    // {"add": [{"id", "first", "last"}, ...], "remove": ["id", ...]}.
+    // Removals are applied first; each rejected entry is listed in "errors".
+    patch("/class/students", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        std::lock_guard<std::mutex> roster_lock(s.roster_mutex);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.sdk_class) {
+            res.status = 400;
+            res.set_content("{\"error\":\"No class setup. Use /class/setup first.\"}", "application/json");
+            return;
+        }
+        int added = 0, removed = 0;
+        std::string errors;
+        auto fail = [&](std::string_view id, const char* what) {
+            if (!errors.empty()) errors += ",";
+            errors += "{\"id\":";
+            append_json_string(errors, id);
+            errors += std::string(",\"error\":\"") + what + "\"}";
+        };
+        try {
+            auto j = json::parse(req.body);
+            g_sdk.call([&] {
+                for (const auto& item : j.value("remove", json::array())) {
+                    std::string id = item.is_string() ? item.get<std::string>() : std::string();
+                    uint32_t index = s.student_ids.find(id);
+                    if (!on_roster(s, index)) {
+                        fail(id, "not on roster");
+                        continue;
+                    }
+                    remove_roster_student(s, index, true);
+                    ++removed;
+                }
+                for (const auto& item : j.value("add", json::array())) {
+                    RosterStudent st;
+                    if (!parse_roster_student(item, st)) {
+                        fail(st.id, "id, first and last are required");
+                    } else if (!add_roster_student(s, st)) {
+                        fail(st.id, "rejected by SDK");
+                    } else {
+                        ++added;
+                    }
+                }
+            });
+        } catch (const std::exception& ex) {
+            res.status = 400;
+            res.set_content(error_json(ex.what()), "application/json");
+            return;
+        }
+        publish_changes(s);
+        res.set_content("{\"added\":" + std::to_string(added) + ",\"removed\":" + std::to_string(removed) +
+                        ",\"students\":" + std::to_string(s.roster_size) + ",\"errors\":[" + errors + "]}", "application/json");
+    });
+
+    // Streams a whole roster, with the same effect as /class/setup. The body
+    // is CSV (text/csv or ?format=csv; columns id,first,last or a header
+    // naming them), NDJSON (application/x-ndjson or ?format=ndjson) or the
+    // /class/setup JSON. CSV and NDJSON are applied as chunks arrive and
+    // never buffered whole; JSON is read with the SAX parser. The class
+    // name comes from ?className= or the JSON body. Invalid records are
+    // skipped and listed in "errors".
+    auto import_roster = in_session([](Session& s, const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& content) {
+        std::lock_guard<std::mutex> roster_lock(s.roster_mutex);
+        RosterUpdate update(s);
+        if (req.has_param("className")) update.class_name(req.get_param_value("className"));
+        std::string format = req.get_param_value("format");
+        std::string type = req.get_header_value("Content-Type");
+        if (format.empty()) format = type.find("csv") != std::string::npos ? "csv" : type.find("ndjson") != std::string::npos ? "ndjson" : "json";
+        bool complete;
+        std::string error;
+        if (format == "csv") {
+            CsvRosterReader<RosterUpdate> reader(update);
+            complete = content([&](const char* data, size_t len) { reader.feed(data, len); return true; });
+            reader.finish();
+            if (!complete) error = "Upload interrupted";
+        } else if (format == "ndjson") {
+            NdjsonRosterReader<RosterUpdate> reader(update);
+            complete = content([&](const char* data, size_t len) { reader.feed(data, len); return true; });
+            reader.finish();
+            if (!complete) error = "Upload interrupted";
+        } else if (format == "json") {
+            std::string body;
+            complete = content([&](const char* data, size_t len) { body.append(data, len); return true; }) &&
+                       read_roster_json(body, update, error);
+        } else {
+            res.status = 400;
+            res.set_content("{\"error\":\"format must be csv, ndjson or json\"}", "application/json");
+            return;
+        }
+        std::string finish_error;
+        bool ok = update.finish(complete, finish_error) && complete;
+        if (error.empty()) error = finish_error;
+        std::string json = std::string("{\"status\":\"") + (ok ? "roster imported" : "roster import failed") + "\"";
+        if (!ok) {
+            res.status = 400;
+            json += ",\"error\":";
+            append_json_string(json, error);
+        }
+        json += ",\"students\":" + std::to_string(s.roster_size) + ",\"imported\":" + std::to_string(update.imported()) +
+                ",\"rejected\":" + std::to_string(update.rejected()) + ",\"errors\":[" + update.errors_json() + "]}";
+        res.set_content(json, "application/json");
+    });
+    svr.Post("/class/import", import_roster);
+    svr.Post("/sessions/:id/class/import", import_roster);
+
+    get("/class/students", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        std::string json = "{\"students\":[";
+        for (uint32_t i = 0; i < (uint32_t)s.student_ids.size(); ++i) {
+            if (i) json += ",";
+            json += "{\"id\":";
+            append_json_string(json, s.student_ids.id(i));
+            json += ",\"first\":";
+            append_json_string(json, s.student_ids.first(i));
+            json += ",\"last\":";
+            append_json_string(json, s.student_ids.last(i));
+            json += std::string(",\"roster\":") + (on_roster(s, i) ? "true" : "false") + "}";
+        }
+        json += "]}";
+        res.set_content(json, "application/json");
+    });
+
+    // Starts a bank of questions as one SDK question set; see
+    // setup_quiz_from_json for the body.
+    post("/quiz/start", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        if (!await_connection(s, req, res)) return;
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.quiz_active) {
+            res.set_content("{\"status\":\"already running\"}", "application/json");
+            return;
+        }
+        if (s.poll_active) {
+            res.status = 400;
+            res.set_content("{\"error\":\"A poll is running. Use /poll/stop first.\"}", "application/json");
+            return;
+        }
+        if (!s.sdk_class || !s.roster_size) {
+            res.status = 400;
+            res.set_content("{\"error\":\"No class/students setup. Use /class/setup first.\"}", "application/json");
+            return;
+        }
+        std::string error;
+        QuestionGroup* g = open_group(s, true, req.body, now_us(), error);
+        if (!g) {
+            res.status = 400;
+            res.set_content(error_json(error), "application/json");
+            return;
+        }
+        g_sdk.call([&] {
+            smartresponse_connectionV2_startclass(s.connection, s.sdk_class);
+            smartresponse_connectionV1_startquestionset(s.connection, g->set);
+        });
+        s.quiz_active = true;
+        publish_changes(s);
+        res.set_content("{\"status\":\"quiz started\",\"quiz\":" + std::to_string(g->poll) + ",\"questions\":" +
+                        std::to_string(g->questions.size()) + "}", "application/json");
+    });
+
+    post("/quiz/stop", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        if (!await_connection(s, req, res)) return;
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.quiz_active) {
+            res.set_content("{\"status\":\"no quiz running\"}", "application/json");
+            return;
+        }
+        g_sdk.call([&] { smartresponse_connectionV1_stopquestionset(s.connection); });
+        stop_group(s);
+        res.set_content("{\"status\":\"quiz stopped\"}", "application/json");
+    });
+
+    // Per-question counts and percent correct, and per-student totals of
+    // the running or last quiz, or of ?quiz=<n>. ?answers=1 adds each
+    // student's current answer to every question (null if unanswered).
+    get("/quiz/results", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        QuestionGroup* g;
+        if (!find_group_param(s, req, res, true, g)) return;
+        if (!g) {
+            res.status = 400;
+            res.set_content("{\"error\":\"No quiz. Use /quiz/start first.\"}", "application/json");
+            return;
+        }
+        bool answers = req.get_param_value("answers") == "1";
+        double possible = 0;
+        for (const auto& q : g->results)
+            if (q.marks().scored()) possible += q.marks().points();
+        std::string json = "{\"quiz\":" + std::to_string(g->poll) + ",\"name\":";
+        append_json_string(json, g->name);
+        json += std::string(",\"active\":") + (s.quiz_active && g == &s.groups.back() ? "true" : "false") +
+                ",\"unrouted\":" + std::to_string(g->unrouted) + ",\"possible\":";
+        append_number_json(json, possible);
+        json += ",\"questions\":[";
+        for (size_t i = 0; i < g->results.size(); ++i) {
+            const QuestionResults& q = g->results[i];
+            if (i) json += ",";
+            json += "{\"question\":" + std::to_string(i + 1) + ",\"type\":";
+            append_json_string(json, question_type_name(q.config().type));
+            json += ",\"responses\":" + std::to_string(q.tally().responses()) + ",\"other\":" + std::to_string(q.tally().other()) + ",\"choices\":[";
+            for (int c = 0; c < q.tally().choice_count(); ++c) {
+                if (c) json += ",";
+                json += "{\"label\":";
+                append_json_string(json, q.decode(1u << c));
+                json += ",\"count\":" + std::to_string(q.tally().count(c)) + "}";
+            }
+            json += "]";
+            if (q.marks().scored()) {
+                json += ",\"points\":";
+                append_number_json(json, q.marks().points());
+                json += ",\"correct\":" + std::to_string(q.marks().correct()) + ",\"percentCorrect\":";
+                if (q.marks().answered()) append_number_json(json, 100.0 * (double)q.marks().correct() / (double)q.marks().answered());
+                else json += "null";
+            }
+            json += "}";
+        }
+        json += "],\"students\":[";
+        for (uint32_t student = 0; student < (uint32_t)s.student_ids.size(); ++student) {
+            GroupStudent st = student < g->students.size() ? g->students[student] : GroupStudent();
+            if (student) json += ",";
+            json += "{\"studentId\":";
+            append_json_string(json, s.student_ids.id(student));
+            json += ",\"answered\":" + std::to_string(st.answered) + ",\"correct\":" + std::to_string(st.correct) + ",\"score\":";
+            append_number_json(json, st.score);
+            if (answers) {
+                json += ",\"answers\":[";
+                for (size_t i = 0; i < g->results.size(); ++i) {
+                    if (i) json += ",";
+                    uint32_t a = g->results[i].latest().get(student);
+                    if (a == LatestAnswers::kNone) json += "null";
+                    else append_json_string(json, g->results[i].decode(a));
+                }
+                json += "]";
+            }
+            json += "}";
         }
         json += "]}";
         res.set_content(json, "application/json");
     });
 
-    std::cout << "Server started at http://localhost:8080\n";
-    svr.listen("0.0.0.0", 8080);
-    cleanup();
+    // Current answer of each student who responded. ?history=1 returns the
+    // answer-change log instead (empty if the poll was started with
+    // "history": false). ?since=<seq> returns only changes after seq; "seq"
+    // in the reply is the high-water mark to pass next time, and "poll"
+    // changes when a new poll starts. ?poll=<n> reads an earlier poll.
+    get("/poll/results", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        uint64_t since = 0;
+        if (!parse_seq_param(req, "since", since, res)) return;
+        bool history = req.get_param_value("history") == "1";
+        if (!history && !req.has_param("since") && !req.has_param("poll")) {
+            send_snapshot(s, req, res, s.results_snapshot, [&] { return results_json(s, latest_group(s, false), false, false, 0); });
+            return;
+        }
+        std::lock_guard<std::mutex> lock(s.mutex);
+        QuestionGroup* g;
+        if (!find_group_param(s, req, res, false, g)) return;
+        res.set_content(results_json(s, g, history, req.has_param("since"), since), "application/json");
+    });
+
+    // Long-poll variant of /poll/results?since=<seq>: parks until a change
+    // past since arrives, a new poll starts, the roster changes, or
+    // ?timeout=<ms> (default 25s, max 60s) expires, then replies exactly
+    // like the delta query. Waiting happens on s.changes, not s.mutex.
+    // Without since it waits for the next change.
+    get("/poll/results/wait", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        uint64_t since = s.published_seq.load(std::memory_order_acquire);
+        uint64_t timeout_ms = 25000;
+        if (!parse_seq_param(req, "since", since, res)) return;
+        if (!parse_seq_param(req, "timeout", timeout_ms, res)) return;
+        timeout_ms = std::min<uint64_t>(timeout_ms, 60000);
+        uint32_t poll = s.published_poll.load(std::memory_order_acquire);
+        uint64_t roster = s.roster_generation.load();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        uint64_t version = s.changes.version();
+        while (s.published_seq.load(std::memory_order_acquire) <= since &&
+               s.published_poll.load(std::memory_order_acquire) == poll && s.roster_generation.load() == roster) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) break;
+            version = s.changes.wait_for_change(version, deadline - now);
+        }
+        std::lock_guard<std::mutex> lock(s.mutex);
+        res.set_content(results_json(s, latest_group(s, false), false, true, since), "application/json");
+    });
+
+    // Per-choice counts for the current poll, or ?poll=<n>; O(choices), not
+    // O(responses). Short-text polls list the 10 most frequent answers, or
+    // ?top=<k>.
+    get("/poll/summary", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        if (req.has_param("top") || req.has_param("poll")) {
+            uint64_t top = kDefaultTextTop;
+            if (!parse_seq_param(req, "top", top, res)) return;
+            std::string json;
+            std::lock_guard<std::mutex> lock(s.mutex);
+            QuestionGroup* g;
+            if (!find_group_param(s, req, res, false, g)) return;
+            append_summary_json(json, poll_results(g), (size_t)top);
+            res.set_content(json, "application/json");
+            return;
+        }
+        send_snapshot(s, req, res, s.summary_snapshot, [&] {
+            std::string json;
+            append_summary_json(json, poll_results(latest_group(s, false)));
+            return json;
+        });
+    });
+
+    // Live results as Server-Sent Events. Resumes after ?since=<seq> or the
+    // Last-Event-ID header; without either it starts with the current answers.
+    get("/poll/stream", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        auto cursor = std::make_shared<StreamCursor>();
+        if (!parse_seq_param(req, "since", cursor->seq, res)) return;
+        if (req.has_header("Last-Event-ID")) {
+            try {
+                cursor->seq = std::stoull(req.get_header_value("Last-Event-ID"));
+            } catch (const std::exception&) {
+            }
+        }
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream", [session = s.shared_from_this(), cursor](size_t, httplib::DataSink& sink) {
+            return write_stream_events(*session, *cursor, sink);
+        });
+    });
+
+    // Replays a recorded session log into this session's running poll or
+    // quiz, or with ?offline=1 into the polls and quizzes it recorded (see
+    // "Response replay"): ?log=<session id> names a log in the data
+    // directory, otherwise the body is the log itself. ?speed=<n> plays it
+    // n times faster than recorded (default 1), ?speed=max back to back;
+    // ?maxGap=<ms> cuts longer pauses. Returns at once; GET /replay reports
+    // progress, throughput and receive-to-publish latency.
+    post("/replay", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        bool offline = req.get_param_value("offline") == "1";
+        ResponseReplay::Options options;
+        try {
+            if (req.has_param("speed")) {
+                std::string speed = req.get_param_value("speed");
+                options.speed = speed == "max" ? 0 : std::stod(speed);
+                if (!(options.speed >= 0) || !std::isfinite(options.speed)) throw std::invalid_argument("speed");
+            }
+            if (req.has_param("maxGap")) options.max_gap_us = std::stoull(req.get_param_value("maxGap")) * 1000;
+        } catch (const std::exception&) {
+            res.status = 400;
+            res.set_content("{\"error\":\"speed must be a positive number or max, maxGap a number of milliseconds\"}", "application/json");
+            return;
+        }
+        WalReader log;
+        std::string error;
+        if (req.has_param("log")) {
+            std::string id = req.get_param_value("log");
+            if (g_data_dir.empty() || !valid_session_id(id)) {
+                res.status = 404;
+                res.set_content("{\"error\":\"No such session log\"}", "application/json");
+                return;
+            }
+            if (!log.open((std::filesystem::path(g_data_dir) / (id + ".wal")).string(), error)) {
+                res.status = 400;
+                res.set_content("{\"error\":\"Not a session log\"}", "application/json");
+                return;
+            }
+        } else if (!log.load(req.body)) {
+            res.status = 400;
+            res.set_content("{\"error\":\"Body is not a session log\"}", "application/json");
+            return;
+        }
+        bool snapshot;
+        std::vector<ReplayEvent> events = load_replay_trace(log, snapshot);
+        size_t responses = 0, polls = 0;
+        for (const auto& e : events) {
+            responses += e.kind == ReplayEvent::kResponse;
+            polls += e.kind == ReplayEvent::kStart;
+        }
+        if (!offline) events.erase(std::remove_if(events.begin(), events.end(), [](const ReplayEvent& e) { return e.kind != ReplayEvent::kResponse; }), events.end());
+        if (!responses) {
+            res.status = 400;
+            res.set_content("{\"error\":\"The log has no responses\"}", "application/json");
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (offline && (s.poll_active || s.quiz_active)) {
+                res.status = 409;
+                res.set_content("{\"error\":\"A poll or quiz is running. Stop it, or replay into a session of its own.\"}", "application/json");
+                return;
+            }
+            if (!offline && !s.poll_active && !s.quiz_active) {
+                res.status = 400;
+                res.set_content("{\"error\":\"No poll or quiz running. Start one to replay into, or use offline=1.\"}", "application/json");
+                return;
+            }
+            if (s.replay.status().running) {
+                res.status = 409;
+                res.set_content("{\"error\":\"A replay is running. Use /replay/stop first.\"}", "application/json");
+                return;
+            }
+            s.replay_drops = s.ring.dropped();
+            s.replay_snapshot = snapshot;
+            s.ingest_latency.reset();
+            if (offline) {
+                s.replay.start(std::move(events), options, now_us(), [&s, polls = std::map<uint16_t, uint16_t>()](ReplayEvent& e) mutable {
+                    replay_offline_event(s, polls, e);
+                });
+            } else {
+                s.replay.start(std::move(events), options, now_us(), [&s](ReplayEvent& e) {
+                    on_student_responded(e.id.data(), e.question_id.data(), e.answer.data(), &s);
+                });
+            }
+        }
+        res.status = 202;
+        std::string json = "{\"status\":\"replay started\",\"responses\":" + std::to_string(responses);
+        if (offline) json += ",\"polls\":" + std::to_string(polls);
+        json += std::string(",\"snapshot\":") + (snapshot ? "true" : "false") + "}";
+        res.set_content(json, "application/json");
+    });
+
+    get("/replay", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        std::string json;
+        append_replay_json(s, json);
+        res.set_content(json, "application/json");
+    });
+
+    post("/replay/stop", [](Session& s, const httplib::Request& req, httplib::Response& res) {
+        s.replay.stop();
+        std::string json;
+        append_replay_json(s, json);
+        res.set_content(json, "application/json");
+    });
+
+    // The main thread pumps the SDK; the server and its workers run beside
+    // it. Sessions are torn down on the server thread while the dispatcher
+    // still runs, since their SDK objects are released through it.
+    std::thread http([&svr] {
+        std::cout << "Server started at http://localhost:8080\n";
+        if (!svr.listen("0.0.0.0", 8080)) std::cerr << "Failed to listen on port 8080" << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(g_sessions_mutex);
+            g_sessions.clear();
+        }
+        g_sdk.stop();
+    });
+    g_sdk.run();
+    http.join();
+    g_archive.close();
+    smartresponse_sdk_terminate();
     return 0;
 }
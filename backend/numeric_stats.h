@@ -0,0 +1,290 @@
+// Streaming statistics for decimal and fractional answers.
+//
+// Answers are parsed once at ingestion into an exact rational plus its
+// double value. NumericStats keeps count, exact and floating sums, a
+// Welford mean/variance, min/max and a fixed-size logarithmic quantile
+// sketch. Every piece supports removal, so a student changing an answer is
+// a remove followed by an add, and memory stays constant however many
+// responses arrive.
+
+#ifndef NUMERIC_STATS_H
+#define NUMERIC_STATS_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+struct Rational {
+    int64_t num = 0;
+    int64_t den = 1;   // always > 0, fraction kept in lowest terms
+};
+
+inline int64_t gcd64(int64_t a, int64_t b) {
+    if (a < 0) a = -a;
+    if (b < 0) b = -b;
+    while (b) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Overflow-checked helpers; return false instead of wrapping.
+inline bool checked_mul(int64_t a, int64_t b, int64_t& out) {
+    if (a == 0 || b == 0) {
+        out = 0;
+        return true;
+    }
+    if (std::llabs(a) > std::numeric_limits<int64_t>::max() / std::llabs(b)) return false;
+    out = a * b;
+    return true;
+}
+
+inline bool checked_add(int64_t a, int64_t b, int64_t& out) {
+    if ((b > 0 && a > std::numeric_limits<int64_t>::max() - b) || (b < 0 && a < std::numeric_limits<int64_t>::min() - b))
+        return false;
+    out = a + b;
+    return true;
+}
+
+inline bool rational_add(const Rational& a, const Rational& b, Rational& out) {
+    int64_t g = gcd64(a.den, b.den);
+    int64_t l, r, den;
+    if (!checked_mul(a.num, b.den / g, l) || !checked_mul(b.num, a.den / g, r) || !checked_mul(a.den / g, b.den, den))
+        return false;
+    int64_t num;
+    if (!checked_add(l, r, num)) return false;
+    int64_t k = gcd64(num, den);
+    out.num = k ? num / k : 0;
+    out.den = k ? den / k : 1;
+    return true;
+}
+
+// Parses SDK numeric answers: decimals ("-12.345") and fractions
+// ("-12 34/57", "34/57", "7"). Surrounding whitespace is ignored.
+inline bool parse_numeric_answer(const char* s, Rational& value) {
+    auto digits = [](const char*& p, int64_t& v, int& count) {
+        v = 0;
+        count = 0;
+        while (*p >= '0' && *p <= '9') {
+            if (count >= 18) return false;
+            v = v * 10 + (*p++ - '0');
+            ++count;
+        }
+        return true;
+    };
+    while (*s == ' ') ++s;
+    bool neg = false;
+    if (*s == '-' || *s == '+') neg = *s++ == '-';
+    int64_t whole, num = 0, den = 1;
+    int n;
+    if (!digits(s, whole, n)) return false;
+    if (*s == '.') {
+        ++s;
+        int fn;
+        if (!digits(s, num, fn) || (n == 0 && fn == 0) || n + fn > 18) return false;
+        for (int i = 0; i < fn; ++i) den *= 10;
+        num += whole * den;
+    } else if (*s == '/') {
+        // "34/57": what was parsed as the whole part is the numerator.
+        ++s;
+        int dn;
+        if (n == 0 || !digits(s, den, dn) || dn == 0 || den == 0) return false;
+        num = whole;
+    } else {
+        if (n == 0) return false;
+        num = whole;
+        const char* p = s;
+        while (*p == ' ') ++p;
+        if (*p >= '0' && *p <= '9') {
+            // "12 34/57"
+            int64_t fnum;
+            int fnn, dn;
+            if (!digits(p, fnum, fnn) || *p++ != '/' || !digits(p, den, dn) || dn == 0 || den == 0) return false;
+            if (!checked_mul(whole, den, num) || !checked_add(num, fnum, num)) return false;
+            s = p;
+        }
+    }
+    while (*s == ' ') ++s;
+    if (*s) return false;
+    int64_t g = gcd64(num, den);
+    value.num = neg ? -(num / g) : num / g;
+    value.den = den / g;
+    return true;
+}
+
+// Relative-error quantile sketch over fixed logarithmic bins (the DDSketch
+// layout). Values are mapped to bin ceil(log_gamma(|x|)); any quantile is
+// within kAlpha relative error. Counts can be decremented, unlike
+// rank-based sketches, which is what answer changes need.
+class QuantileSketch {
+public:
+    static constexpr double kAlpha = 0.01;
+    static constexpr int kMinIndex = -704;   // |x| ~ 1e-6; smaller goes to the zero bin
+    static constexpr int kBins = 2112;       // up to |x| ~ 1.6e12
+
+    QuantileSketch() : gamma_((1 + kAlpha) / (1 - kAlpha)), log_gamma_(std::log(gamma_)) { clear(); }
+
+    void clear() {
+        pos_.assign(kBins, 0);
+        neg_.assign(kBins, 0);
+        zero_ = 0;
+        count_ = 0;
+    }
+
+    void add(double x, int delta) {
+        count_ += delta;
+        double m = std::fabs(x);
+        if (m < min_magnitude()) {
+            zero_ += delta;
+            return;
+        }
+        (x > 0 ? pos_ : neg_)[bin(m)] += delta;
+    }
+
+    int64_t count() const { return count_; }
+
+    // Value at quantile q in [0, 1]. O(kBins).
+    double quantile(double q) const {
+        if (count_ <= 0) return std::numeric_limits<double>::quiet_NaN();
+        int64_t rank = (int64_t)(q * (double)(count_ - 1));
+        int64_t seen = 0;
+        for (int i = kBins - 1; i >= 0; --i) {
+            seen += neg_[i];
+            if (seen > rank) return -value(i);
+        }
+        seen += zero_;
+        if (seen > rank) return 0;
+        for (int i = 0; i < kBins; ++i) {
+            seen += pos_[i];
+            if (seen > rank) return value(i);
+        }
+        return value(kBins - 1);
+    }
+
+    // Calls fn(value, count) for every non-empty bin in ascending order.
+    template <class Fn>
+    void for_each_bin(Fn&& fn) const {
+        for (int i = kBins - 1; i >= 0; --i)
+            if (neg_[i]) fn(-value(i), neg_[i]);
+        if (zero_) fn(0.0, zero_);
+        for (int i = 0; i < kBins; ++i)
+            if (pos_[i]) fn(value(i), pos_[i]);
+    }
+
+private:
+    double min_magnitude() const { return std::pow(gamma_, kMinIndex); }
+
+    int bin(double m) const {
+        int i = (int)std::ceil(std::log(m) / log_gamma_) - kMinIndex;
+        return i < 0 ? 0 : i >= kBins ? kBins - 1 : i;
+    }
+
+    // Representative value of a bin, equidistant in relative terms from its bounds.
+    double value(int i) const { return 2 * std::pow(gamma_, i + kMinIndex) / (gamma_ + 1); }
+
+    double gamma_;
+    double log_gamma_;
+    std::vector<int32_t> pos_;
+    std::vector<int32_t> neg_;
+    int64_t zero_ = 0;
+    int64_t count_ = 0;
+};
+
+class NumericStats {
+public:
+    void clear() {
+        count_ = 0;
+        mean_ = 0;
+        m2_ = 0;
+        sum_ = Rational{};
+        exact_ = true;
+        min_ = max_ = 0;
+        extremes_dirty_ = false;
+        sketch_.clear();
+    }
+
+    void add(const Rational& r) {
+        double x = (double)r.num / (double)r.den;
+        ++count_;
+        double delta = x - mean_;
+        mean_ += delta / (double)count_;
+        m2_ += delta * (x - mean_);
+        if (exact_ && !rational_add(sum_, r, sum_)) exact_ = false;
+        if (count_ == 1 || x < min_) min_ = x;
+        if (count_ == 1 || x > max_) max_ = x;
+        sketch_.add(x, 1);
+    }
+
+    void remove(const Rational& r) {
+        double x = (double)r.num / (double)r.den;
+        if (count_ <= 1) {
+            clear();
+            return;
+        }
+        --count_;
+        double delta = x - mean_;
+        mean_ -= delta / (double)count_;
+        m2_ -= delta * (x - mean_);
+        if (m2_ < 0) m2_ = 0;
+        if (exact_ && !rational_add(sum_, Rational{-r.num, r.den}, sum_)) exact_ = false;
+        // The sketch cannot recover an exact extreme; the owner rescans.
+        if (x <= min_ || x >= max_) extremes_dirty_ = true;
+        sketch_.add(x, -1);
+    }
+
+    // True after removing the current min or max; refresh_extremes() must be
+    // called with every remaining value before min()/max() are exact again.
+    bool extremes_dirty() const { return extremes_dirty_; }
+
+    template <class ForEachValue>
+    void refresh_extremes(ForEachValue&& for_each_value) {
+        bool first = true;
+        for_each_value([&](double x) {
+            if (first || x < min_) min_ = x;
+            if (first || x > max_) max_ = x;
+            first = false;
+        });
+        extremes_dirty_ = false;
+    }
+
+    int64_t count() const { return count_; }
+    double mean() const { return mean_; }
+    double variance() const { return count_ > 1 ? m2_ / (double)(count_ - 1) : 0; }
+    double min() const { return min_; }
+    double max() const { return max_; }
+    // Exact sum, valid while sum_exact() (no int64 overflow so far).
+    const Rational& sum() const { return sum_; }
+    bool sum_exact() const { return exact_; }
+    double quantile(double q) const { return sketch_.quantile(q); }
+
+    // Equal-width histogram of bins buckets over [min, max], built from the
+    // sketch bins. O(sketch size), independent of the number of answers.
+    std::vector<int64_t> histogram(int bins) const {
+        std::vector<int64_t> out(bins > 0 ? bins : 1, 0);
+        double span = max_ - min_;
+        sketch_.for_each_bin([&](double v, int64_t c) {
+            int i = span > 0 ? (int)((v - min_) / span * (double)out.size()) : 0;
+            if (i < 0) i = 0;
+            if (i >= (int)out.size()) i = (int)out.size() - 1;
+            out[i] += c;
+        });
+        return out;
+    }
+
+private:
+    int64_t count_ = 0;
+    double mean_ = 0;
+    double m2_ = 0;
+    Rational sum_;
+    bool exact_ = true;
+    double min_ = 0;
+    double max_ = 0;
+    bool extremes_dirty_ = false;
+    QuantileSketch sketch_;
+};
+
+#endif
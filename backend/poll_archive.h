@@ -0,0 +1,493 @@
+// Archive of finished polls and quizzes.
+//
+// A stopped poll or quiz is sealed into an immutable column file,
+// <dir>/<id>.col, and listed in <dir>/index.bin. Both are read through
+// read-only memory mappings: lookups use the on-disk structs in place,
+// with no deserialization, and a reader pages in only the columns it
+// touches. Column file layout (host byte order, little-endian; every
+// section 8-byte aligned):
+//   ArchiveHeader
+//   ArchiveQuestion[questions]
+//   ArchiveStudent[students]      ids and names, by student index
+//   per question:
+//     ArchiveString[choice_count] choice texts
+//     uint32_t[rows]              student column
+//     uint32_t[rows]              answer column
+//     uint32_t[rows]              time column, ms after started_us
+//     ArchiveString[text_answers]
+//   string pool
+// A row is a student's final answer to a question. Answers are encoded as
+// in the live results: a choice bitmask, or kTextAnswer | i for the
+// question's i-th text answer.
+//
+// index.bin is an array of fixed-size ArchiveIndexEntry records in the
+// order polls were sealed. A column file is synced and renamed into place
+// before its entry is appended, so every complete entry names a complete
+// file; a partial entry left by a crash is ignored.
+//
+// PollArchiver seals on its own thread, so stopping a poll never waits on
+// the disk.
+
+#ifndef POLL_ARCHIVE_H
+#define POLL_ARCHIVE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "response_store.h"
+#include "wal.h"
+
+static constexpr char kArchiveMagic[8] = {'S', 'R', 'P', 'O', 'L', 'L', '0', '1'};
+
+struct ArchiveString {
+    uint32_t offset;    // into the string pool
+    uint32_t size;
+};
+
+struct ArchiveHeader {
+    char magic[8];
+    uint32_t questions;
+    uint32_t students;
+    uint64_t started_us;
+    uint64_t stopped_us;
+    uint16_t poll;
+    uint8_t quiz;
+    uint8_t reserved[5];
+    ArchiveString session, class_name, name;
+    uint64_t students_offset;
+    uint64_t pool_offset;
+    uint64_t pool_size;
+};
+static_assert(sizeof(ArchiveHeader) == 88, "ArchiveHeader is an on-disk layout");
+
+struct ArchiveQuestion {
+    int32_t type;
+    int32_t choice_count;
+    double points;
+    ArchiveString text, answer;     // as the SDK question reports them
+    uint32_t rows;
+    uint32_t text_answers;
+    uint32_t correct;               // rows marked correct, if scored
+    uint8_t scored;
+    uint8_t reserved[3];
+    uint64_t choices_offset;
+    uint64_t student_column;
+    uint64_t answer_column;
+    uint64_t time_column;
+    uint64_t text_answers_offset;
+};
+static_assert(sizeof(ArchiveQuestion) == 88, "ArchiveQuestion is an on-disk layout");
+
+struct ArchiveStudent {
+    ArchiveString id, first, last;
+};
+
+struct ArchiveIndexEntry {
+    uint64_t id;
+    uint64_t started_us;
+    uint64_t stopped_us;
+    uint32_t questions;
+    uint32_t rows;                  // over all questions
+    uint32_t students;
+    uint16_t poll;
+    uint8_t quiz;
+    uint8_t reserved;
+    char session[40];               // NUL-padded
+    char class_name[64];            // NUL-padded; longer names are cut to 63 bytes
+};
+static_assert(sizeof(ArchiveIndexEntry) == 144, "ArchiveIndexEntry is an on-disk layout");
+
+// A finished poll or quiz, copied out of the live results for sealing.
+struct SealedPoll {
+    struct Question {
+        int type = 0;
+        double points = 0;
+        bool scored = false;
+        uint32_t correct = 0;
+        std::string text, answer;
+        std::vector<std::string> choices;
+        std::vector<uint32_t> students, answers, times;
+        std::vector<std::string> text_answers;
+    };
+    struct Student {
+        std::string id, first, last;
+    };
+    std::string session, class_name, name;
+    uint16_t poll = 0;
+    bool quiz = false;
+    uint64_t started_us = 0;
+    uint64_t stopped_us = 0;
+    std::vector<Student> students;
+    std::vector<Question> questions;
+};
+
+// Column file of archived poll id in dir.
+inline std::string archive_path(const std::string& dir, uint64_t id) {
+    return (std::filesystem::path(dir) / (std::to_string(id) + ".col")).string();
+}
+
+// Lays out a column file.
+inline std::string encode_archive(const SealedPoll& p) {
+    std::string pool;
+    auto str = [&](std::string_view s) {
+        ArchiveString a{(uint32_t)pool.size(), (uint32_t)s.size()};
+        pool.append(s);
+        return a;
+    };
+    auto align = [](uint64_t n) { return (n + 7) & ~uint64_t(7); };
+
+    ArchiveHeader h{};
+    memcpy(h.magic, kArchiveMagic, sizeof(h.magic));
+    h.questions = (uint32_t)p.questions.size();
+    h.students = (uint32_t)p.students.size();
+    h.started_us = p.started_us;
+    h.stopped_us = p.stopped_us;
+    h.poll = p.poll;
+    h.quiz = p.quiz;
+    h.session = str(p.session);
+    h.class_name = str(p.class_name);
+    h.name = str(p.name);
+
+    std::vector<ArchiveStudent> students;
+    students.reserve(p.students.size());
+    for (const auto& st : p.students) students.push_back({str(st.id), str(st.first), str(st.last)});
+    uint64_t at = sizeof(ArchiveHeader) + sizeof(ArchiveQuestion) * p.questions.size();
+    h.students_offset = at;
+    at = align(at + sizeof(ArchiveStudent) * students.size());
+
+    std::vector<ArchiveQuestion> questions;
+    std::vector<std::vector<ArchiveString>> choices(p.questions.size()), texts(p.questions.size());
+    for (size_t i = 0; i < p.questions.size(); ++i) {
+        const auto& q = p.questions[i];
+        ArchiveQuestion a{};
+        a.type = q.type;
+        a.choice_count = (int32_t)q.choices.size();
+        a.points = q.points;
+        a.text = str(q.text);
+        a.answer = str(q.answer);
+        a.rows = (uint32_t)q.students.size();
+        a.text_answers = (uint32_t)q.text_answers.size();
+        a.correct = q.correct;
+        a.scored = q.scored;
+        for (const auto& c : q.choices) choices[i].push_back(str(c));
+        for (const auto& t : q.text_answers) texts[i].push_back(str(t));
+        a.choices_offset = at;
+        at = align(at + sizeof(ArchiveString) * choices[i].size());
+        a.student_column = at;
+        at = align(at + 4ull * a.rows);
+        a.answer_column = at;
+        at = align(at + 4ull * a.rows);
+        a.time_column = at;
+        at = align(at + 4ull * a.rows);
+        a.text_answers_offset = at;
+        at = align(at + sizeof(ArchiveString) * texts[i].size());
+        questions.push_back(a);
+    }
+    h.pool_offset = at;
+    h.pool_size = pool.size();
+
+    std::string out;
+    out.reserve(at + pool.size());
+    auto put = [&](const void* data, size_t n) {
+        out.append((const char*)data, n);
+        out.resize(align(out.size()), '\0');
+    };
+    put(&h, sizeof(h));
+    put(questions.data(), sizeof(ArchiveQuestion) * questions.size());
+    put(students.data(), sizeof(ArchiveStudent) * students.size());
+    for (size_t i = 0; i < p.questions.size(); ++i) {
+        const auto& q = p.questions[i];
+        put(choices[i].data(), sizeof(ArchiveString) * choices[i].size());
+        put(q.students.data(), 4 * q.students.size());
+        put(q.answers.data(), 4 * q.answers.size());
+        put(q.times.data(), 4 * q.times.size());
+        put(texts[i].data(), sizeof(ArchiveString) * texts[i].size());
+    }
+    out += pool;
+    return out;
+}
+
+// Read-only mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path, std::string& error) {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            error = "Cannot open " + path;
+            return false;
+        }
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_, &size);
+        size_ = (size_t)size.QuadPart;
+        if (size_) {
+            mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data_ = mapping_ ? (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "Cannot open " + path;
+            return false;
+        }
+        struct stat st;
+        size_ = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+        if (size_) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            data_ = p == MAP_FAILED ? nullptr : (const char*)p;
+        }
+        ::close(fd);
+#endif
+        if (size_ && !data_) {
+            error = "Cannot map " + path;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap((void*)data_, size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+// One sealed poll, read in place.
+class PollArchive {
+public:
+    // Maps path and checks that every section lies inside the file; only the
+    // header and directories are touched.
+    bool open(const std::string& path, std::string& error) {
+        if (!file_.open(path, error)) return false;
+        const ArchiveHeader& h = header();
+        bool ok = file_.size() >= sizeof(ArchiveHeader) && memcmp(h.magic, kArchiveMagic, sizeof(h.magic)) == 0 &&
+                  fits(sizeof(ArchiveHeader), sizeof(ArchiveQuestion) * (uint64_t)h.questions) &&
+                  fits(h.students_offset, sizeof(ArchiveStudent) * (uint64_t)h.students) && fits(h.pool_offset, h.pool_size);
+        for (uint32_t i = 0; ok && i < h.questions; ++i) {
+            const ArchiveQuestion& q = question(i);
+            ok = fits(q.choices_offset, sizeof(ArchiveString) * (uint64_t)std::max(q.choice_count, 0)) &&
+                 fits(q.student_column, 4ull * q.rows) && fits(q.answer_column, 4ull * q.rows) && fits(q.time_column, 4ull * q.rows) &&
+                 fits(q.text_answers_offset, sizeof(ArchiveString) * (uint64_t)q.text_answers);
+        }
+        if (!ok) {
+            error = path + " is not a valid poll archive";
+            file_.close();
+        }
+        return ok;
+    }
+
+    const ArchiveHeader& header() const { return *at<ArchiveHeader>(0); }
+    const ArchiveQuestion& question(uint32_t i) const { return at<ArchiveQuestion>(sizeof(ArchiveHeader))[i]; }
+    const ArchiveStudent& student(uint32_t i) const { return at<ArchiveStudent>(header().students_offset)[i]; }
+    const uint32_t* students(const ArchiveQuestion& q) const { return at<uint32_t>(q.student_column); }
+    const uint32_t* answers(const ArchiveQuestion& q) const { return at<uint32_t>(q.answer_column); }
+    const uint32_t* times(const ArchiveQuestion& q) const { return at<uint32_t>(q.time_column); }
+    std::string_view choice(const ArchiveQuestion& q, int i) const { return str(at<ArchiveString>(q.choices_offset)[i]); }
+    std::string_view text_answer(const ArchiveQuestion& q, uint32_t i) const { return str(at<ArchiveString>(q.text_answers_offset)[i]); }
+
+    // Strings past the pool read as empty.
+    std::string_view str(ArchiveString s) const {
+        const ArchiveHeader& h = header();
+        if ((uint64_t)s.offset + s.size > h.pool_size) return {};
+        return std::string_view(file_.data() + h.pool_offset + s.offset, s.size);
+    }
+
+    std::string decode(const ArchiveQuestion& q, uint32_t code) const {
+        if (!(code & kTextAnswer)) return decode_answer(q.type, code, StringTable());
+        uint32_t i = code & ~kTextAnswer;
+        return i < q.text_answers ? std::string(text_answer(q, i)) : std::string();
+    }
+
+private:
+    template <class T>
+    const T* at(uint64_t offset) const { return reinterpret_cast<const T*>(file_.data() + offset); }
+    bool fits(uint64_t offset, uint64_t size) const { return offset <= file_.size() && size <= file_.size() - offset; }
+
+    MappedFile file_;
+};
+
+// Writes sealed polls and the index on a background thread.
+class PollArchiver {
+public:
+    PollArchiver() = default;
+    PollArchiver(const PollArchiver&) = delete;
+    PollArchiver& operator=(const PollArchiver&) = delete;
+    ~PollArchiver() { close(); }
+
+    // Creates dir if needed and continues numbering after its index.
+    bool open(const std::string& dir, std::string& error) {
+        dir_ = dir;
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        if (ec) {
+            error = "Cannot create " + dir_ + ": " + ec.message();
+            return false;
+        }
+        index_path_ = (std::filesystem::path(dir_) / "index.bin").string();
+        uint64_t size = std::filesystem::exists(index_path_, ec) ? std::filesystem::file_size(index_path_, ec) : 0;
+        if (size % sizeof(ArchiveIndexEntry)) {
+            // A crash cut the last entry short; its file may be complete but
+            // is not listed.
+            std::filesystem::resize_file(index_path_, size - size % sizeof(ArchiveIndexEntry), ec);
+            size -= size % sizeof(ArchiveIndexEntry);
+        }
+        next_id_ = size / sizeof(ArchiveIndexEntry) + 1;
+        running_ = true;
+        thread_ = std::thread(&PollArchiver::seal_loop, this);
+        return true;
+    }
+
+    bool is_open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return running_;
+    }
+    const std::string& dir() const { return dir_; }
+    const std::string& index_path() const { return index_path_; }
+
+    std::string path_of(uint64_t id) const { return archive_path(dir_, id); }
+
+    // Called on the seal thread with each entry once it is in the index;
+    // set before open().
+    void on_sealed(std::function<void(const ArchiveIndexEntry&)> fn) { on_sealed_ = std::move(fn); }
+
+    // Queues p for sealing; never blocks on I/O.
+    void submit(SealedPoll p) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) return;
+            queue_.push_back(std::move(p));
+        }
+        wake_.notify_one();
+    }
+
+    // Number of polls sealed so far in this run.
+    uint64_t sealed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sealed_;
+    }
+
+    // Seals what is queued and stops the thread.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) return;
+            running_ = false;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+private:
+    void seal_loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [&] { return !running_ || !queue_.empty(); });
+            if (queue_.empty()) break;
+            SealedPoll p = std::move(queue_.front());
+            queue_.pop_front();
+            lock.unlock();
+            bool ok = seal(p);
+            lock.lock();
+            if (ok) ++sealed_;
+        }
+    }
+
+    bool seal(const SealedPoll& p) {
+        uint64_t id = next_id_;
+        std::string path = path_of(id), tmp = path + ".tmp";
+        std::string image = encode_archive(p);
+        if (!write_file(tmp, "wb", image.data(), image.size())) return fail("Cannot write " + tmp);
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) return fail("Cannot rename " + tmp + ": " + ec.message());
+
+        ArchiveIndexEntry e{};
+        e.id = id;
+        e.started_us = p.started_us;
+        e.stopped_us = p.stopped_us;
+        e.questions = (uint32_t)p.questions.size();
+        for (const auto& q : p.questions) e.rows += (uint32_t)q.students.size();
+        e.students = (uint32_t)p.students.size();
+        e.poll = p.poll;
+        e.quiz = p.quiz;
+        p.session.copy(e.session, sizeof(e.session) - 1);
+        p.class_name.copy(e.class_name, sizeof(e.class_name) - 1);
+        if (!write_file(index_path_, "ab", &e, sizeof(e))) {
+            // Cut a partial entry off again, or every later one is misaligned.
+            std::filesystem::resize_file(index_path_, (next_id_ - 1) * sizeof(ArchiveIndexEntry), ec);
+            return fail("Cannot append to " + index_path_);
+        }
+        ++next_id_;
+        if (on_sealed_) on_sealed_(e);
+        return true;
+    }
+
+    static bool write_file(const std::string& path, const char* mode, const void* data, size_t size) {
+        std::FILE* f = std::fopen(path.c_str(), mode);
+        if (!f) return false;
+        bool ok = std::fwrite(data, 1, size, f) == size && std::fflush(f) == 0 && sync_file(f);
+        return std::fclose(f) == 0 && ok;
+    }
+
+    static bool fail(const std::string& error) {
+        std::fprintf(stderr, "Poll archive: %s\n", error.c_str());
+        return false;
+    }
+
+    std::string dir_;
+    std::string index_path_;
+    uint64_t next_id_ = 1;          // seal thread only
+    std::function<void(const ArchiveIndexEntry&)> on_sealed_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<SealedPoll> queue_;
+    std::thread thread_;
+    bool running_ = false;
+    uint64_t sealed_ = 0;
+};
+
+#endif
@@ -0,0 +1,210 @@
+// Query index over the poll archive.
+//
+// PollHistory holds every ArchiveIndexEntry of the archive in memory,
+// loaded once from the mapped index.bin and extended as polls are sealed,
+// with two orderings over them: all polls by (start time, id), and per
+// class name the same. A query takes the class list or the full one,
+// binary searches to the start of its range and walks forward, so it costs
+// the page it returns (plus polls skipped by a session filter) however
+// long the archive is.
+//
+// Pages are keyed, not numbered: a Cursor is the (start time, id) of the
+// last poll returned and the next page starts strictly after it, so pages
+// stay put while new polls are sealed.
+//
+// Aggregates add up per-poll summaries (responses, choice counts and
+// correct counts per question). A summary is computed from the poll's
+// answer columns the first time it is needed and kept, since an archived
+// poll never changes.
+
+#ifndef POLL_HISTORY_H
+#define POLL_HISTORY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "poll_archive.h"
+#include "tally.h"
+
+class PollHistory {
+public:
+    struct Cursor {
+        uint64_t started_us = 0;
+        uint64_t id = 0;
+    };
+
+    struct Query {
+        bool by_class = false;
+        std::string class_name;
+        std::string session;            // empty: every session
+        uint64_t from_us = 0;           // started_us >= from_us
+        uint64_t to_us = UINT64_MAX;    // started_us < to_us
+        bool after_cursor = false;
+        Cursor after;
+    };
+
+    struct QuestionSummary {
+        int type = 0;
+        int choices = 0;
+        bool scored = false;
+        uint32_t responses = 0;
+        uint32_t other = 0;
+        uint32_t correct = 0;
+        uint32_t counts[ChoiceTally::kMaxChoices] = {};
+    };
+
+    // Loads the index of the archive in dir, after PollArchiver::open has
+    // dropped any partial entry.
+    bool open(const std::string& dir, std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dir_ = dir;
+        std::string path = (std::filesystem::path(dir) / "index.bin").string();
+        std::error_code ec;
+        if (!std::filesystem::exists(path, ec)) return true;
+        MappedFile index;
+        if (!index.open(path, error)) return false;
+        size_t n = index.size() / sizeof(ArchiveIndexEntry);
+        entries_.resize(n);
+        if (n) memcpy(entries_.data(), index.data(), n * sizeof(ArchiveIndexEntry));
+        summaries_.resize(n);
+        summarized_.assign(n, false);
+        by_time_.resize(n);
+        for (uint32_t i = 0; i < n; ++i) by_time_[i] = i;
+        std::sort(by_time_.begin(), by_time_.end(), [&](uint32_t a, uint32_t b) { return before(a, b); });
+        for (uint32_t i : by_time_) by_class_[class_key(entries_[i].class_name)].push_back(i);
+        return true;
+    }
+
+    // Adds a newly sealed poll; called on the archiver's thread.
+    void add(const ArchiveIndexEntry& e) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t i = (uint32_t)entries_.size();
+        entries_.push_back(e);
+        summaries_.emplace_back();
+        summarized_.push_back(false);
+        insert(by_time_, i);
+        insert(by_class_[class_key(e.class_name)], i);
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    // Calls fn(entry) for up to limit polls matching q, oldest first. Returns
+    // true (and sets next) if more remain.
+    template <class Fn>
+    bool scan(const Query& q, size_t limit, Fn&& fn, Cursor& next) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t n = 0;
+        bool more = false;
+        walk(q, [&](const ArchiveIndexEntry& e) {
+            if (n == limit) {
+                more = true;
+                return false;
+            }
+            fn(e);
+            next = Cursor{e.started_us, e.id};
+            ++n;
+            return true;
+        });
+        return more;
+    }
+
+    // Calls fn(entry, summaries) for every poll matching q, ignoring its
+    // cursor, so an aggregate covers the whole range rather than one page.
+    template <class Fn>
+    void aggregate(Query q, Fn&& fn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        q.after_cursor = false;
+        walk(q, [&](const ArchiveIndexEntry& e) {
+            fn(e, summary(e));
+            return true;
+        });
+    }
+
+    // Index key of a class name: what fits in ArchiveIndexEntry::class_name.
+    static std::string class_key(std::string_view name) {
+        return std::string(name.substr(0, std::min(name.find('\0'), sizeof(ArchiveIndexEntry::class_name) - 1)));
+    }
+
+private:
+    static bool less(uint64_t started_a, uint64_t id_a, uint64_t started_b, uint64_t id_b) {
+        return started_a != started_b ? started_a < started_b : id_a < id_b;
+    }
+    bool before(uint32_t a, uint32_t b) const {
+        return less(entries_[a].started_us, entries_[a].id, entries_[b].started_us, entries_[b].id);
+    }
+
+    // Polls are sealed roughly in start order, so this is almost always an
+    // append.
+    void insert(std::vector<uint32_t>& list, uint32_t i) {
+        list.insert(std::upper_bound(list.begin(), list.end(), i, [&](uint32_t a, uint32_t b) { return before(a, b); }), i);
+    }
+
+    // Calls visit(entry) for polls matching q in order until it returns false.
+    template <class Visit>
+    void walk(const Query& q, Visit&& visit) const {
+        const std::vector<uint32_t>* list = &by_time_;
+        if (q.by_class) {
+            auto it = by_class_.find(class_key(q.class_name));
+            if (it == by_class_.end()) return;
+            list = &it->second;
+        }
+        // First poll at or after from_us and strictly after the cursor.
+        uint64_t start_us = q.from_us, start_id = 0;
+        if (q.after_cursor && !less(q.after.started_us, q.after.id, start_us, start_id)) {
+            start_us = q.after.started_us;
+            start_id = q.after.id + 1;
+        }
+        auto it = std::lower_bound(list->begin(), list->end(), 0u, [&](uint32_t a, uint32_t) {
+            return less(entries_[a].started_us, entries_[a].id, start_us, start_id);
+        });
+        for (; it != list->end(); ++it) {
+            const ArchiveIndexEntry& e = entries_[*it];
+            if (e.started_us >= q.to_us) break;
+            if (!q.session.empty() && q.session != std::string_view(e.session, strnlen(e.session, sizeof(e.session)))) continue;
+            if (!visit(e)) break;
+        }
+    }
+
+    const std::vector<QuestionSummary>& summary(const ArchiveIndexEntry& e) {
+        uint32_t i = (uint32_t)(e.id - 1);      // ids are index positions + 1
+        if (summarized_[i]) return summaries_[i];
+        summarized_[i] = true;
+        PollArchive a;
+        std::string error;
+        if (!a.open(archive_path(dir_, e.id), error)) return summaries_[i];
+        for (uint32_t k = 0; k < a.header().questions; ++k) {
+            const ArchiveQuestion& aq = a.question(k);
+            ChoiceTally tally;
+            tally.reset(aq.type, aq.choice_count);
+            tally.rebuild(a.answers(aq), aq.rows);
+            QuestionSummary s;
+            s.type = aq.type;
+            s.choices = tally.choice_count();
+            s.scored = aq.scored;
+            s.responses = (uint32_t)tally.responses();
+            s.other = (uint32_t)tally.other();
+            s.correct = aq.correct;
+            for (int c = 0; c < s.choices; ++c) s.counts[c] = (uint32_t)tally.count(c);
+            summaries_[i].push_back(s);
+        }
+        return summaries_[i];
+    }
+
+    std::mutex mutex_;
+    std::string dir_;
+    std::vector<ArchiveIndexEntry> entries_;        // in index order: entries_[id - 1]
+    std::vector<std::vector<QuestionSummary>> summaries_;
+    std::vector<bool> summarized_;
+    std::vector<uint32_t> by_time_;                 // entry positions by (started_us, id)
+    std::unordered_map<std::string, std::vector<uint32_t>> by_class_;
+};
+
+#endif
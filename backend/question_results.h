@@ -0,0 +1,263 @@
+// Result state of one question.
+//
+// A QuestionResults bucket holds everything derived from the answers to a
+// single question: each student's current answer, the answer-change log,
+// the choice tally, numeric statistics, the short-text top-K index and the
+// marks against the answer key. A poll has one bucket and a quiz one per
+// question. Buckets outlive the question, so an answer that arrives after
+// the next question started still lands on the one it was given for.
+// Answer text is interned per bucket, and each distinct text is parsed,
+// normalized and marked at most once.
+
+#ifndef QUESTION_RESULTS_H
+#define QUESTION_RESULTS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "response_store.h"
+#include "tally.h"
+#include "numeric_stats.h"
+#include "text_answers.h"
+#include "scoring.h"
+
+// Answer key pre-encoded for its question type: a choice mask, an exact
+// value (decimal/fractional) or a match key (short text).
+struct AnswerKey {
+    bool set = false;
+    uint32_t mask = 0;
+    Rational value;
+    std::string text;
+};
+
+// What a question's results depend on, as given when it was started.
+struct QuestionConfig {
+    int type = 0;
+    int choice_count = 0;
+    std::vector<std::string> choices;   // choice texts, choice-style questions only
+    AnswerKey key;
+    double points = 1;
+    TextMatch text_match = TextMatch::Normalized;
+    bool history = true;                // keep the answer-change log
+};
+
+class QuestionResults {
+public:
+    // Effect of one response: whether the student's answer changed, whether
+    // it is their first answer, and the change in their correct count.
+    struct Change {
+        bool changed = false;
+        bool first = false;
+        int correct = 0;
+    };
+
+    // Starts an empty bucket. Log records are stamped with poll and timed
+    // from epoch_us; the first change is numbered base_seq + 1.
+    void reset(QuestionConfig config, uint16_t poll, size_t students, uint64_t epoch_us, uint64_t base_seq) {
+        config_ = std::move(config);
+        poll_ = poll;
+        last_seq_ = base_seq;
+        log_.reset(epoch_us, base_seq);
+        text_.clear();
+        numeric_text_.clear();
+        text_keys_.clear();
+        text_key_of_.clear();
+        text_marks_.clear();
+        if (is_numeric_question(config_.type)) {
+            if (!numeric_) numeric_ = std::make_unique<NumericStats>();
+        } else {
+            numeric_.reset();
+        }
+        clear_answers(students);
+    }
+
+    // Drops every answer but keeps the question; used when student indices
+    // are reassigned. The log is kept.
+    void clear_answers(size_t students) {
+        latest_.reset(students);
+        tally_.reset(config_.type, config_.choice_count);
+        if (numeric_) numeric_->clear();
+        text_top_.clear();
+        marks_.reset(students, config_.key.set, config_.points);
+    }
+
+    // Stores student's answer. A changed answer is numbered seq and, if
+    // logged, appended to the change log; logged changes must be numbered
+    // consecutively. Answers that are not logged (late answers to a finished
+    // question) still update the aggregates and the student's current answer.
+    Change apply(uint32_t student, const char* raw, uint64_t received_us, uint64_t seq, bool logged) {
+        Change c;
+        uint32_t answer = encode_answer(config_.type, raw, text_);
+        uint32_t prev = latest_.set(student, answer, seq, log_.to_ms(received_us));
+        if (prev == answer) return c;
+        c.changed = true;
+        c.first = prev == LatestAnswers::kNone;
+        last_seq_ = std::max(last_seq_, seq);
+        if (!tally_deferred_) {
+            if (!c.first) tally_.remove(prev);
+            tally_.add(answer);
+        }
+        if (numeric_) {
+            if (const Rational* v = numeric_value(prev)) numeric_->remove(*v);
+            if (const Rational* v = numeric_value(answer)) numeric_->add(*v);
+        }
+        if (config_.type == SMARTRESPONSE_QUESTIONTYPE_SHORTTEXT) update_text_top(prev, answer);
+        if (marks_.scored()) {
+            int was = marks_.mark(student) == ScoreBoard::kCorrect;
+            ScoreBoard::Mark mark = answer_mark(answer);
+            marks_.set(student, mark);
+            c.correct = (mark == ScoreBoard::kCorrect) - was;
+        }
+        if (logged && config_.history) log_.push_back(ResponseRecord{student, poll_, 0, answer, log_.to_ms(received_us)});
+        return c;
+    }
+
+    // Makes numeric min/max exact again after a batch of changes.
+    void refresh_extremes() {
+        if (!numeric_ || !numeric_->extremes_dirty()) return;
+        numeric_->refresh_extremes([&](auto&& visit) {
+            for (size_t i = 0; i < latest_.size(); ++i) {
+                if (const Rational* v = numeric_value(latest_.get((uint32_t)i))) visit((double)v->num / (double)v->den);
+            }
+        });
+    }
+
+    // While deferred, apply() leaves the choice tally alone; ending it
+    // rebuilds the tally from the latest-answer column in one pass. For
+    // replaying a log, where the same answers change many times over.
+    void defer_tally(bool deferred) {
+        tally_deferred_ = deferred;
+        if (!deferred) tally_.rebuild(latest_.data(), latest_.size());
+    }
+
+    // Replaces the answer key and points and re-marks every current answer
+    // in one pass over the latest-answer column.
+    void set_key(const AnswerKey& key, double points) {
+        config_.key = key;
+        config_.points = points;
+        text_marks_.clear();
+        const uint32_t* answers = latest_.data();
+        marks_.rescore(key.set, points, latest_.size(), [&](uint32_t i) { return answer_mark(answers[i]); });
+    }
+
+    // Calls fn(student, answer, seq) for each student whose current answer
+    // changed after since. O(roster).
+    template <class Fn>
+    void for_each_latest_since(uint64_t since, Fn&& fn) const {
+        for (uint32_t i = 0; i < (uint32_t)latest_.size(); ++i) {
+            if (latest_.get(i) != LatestAnswers::kNone && latest_.seq(i) > since) fn(i, latest_.get(i), latest_.seq(i));
+        }
+    }
+
+    // Calls fn(student, answer, seq) for each logged change after since, or
+    // falls back to the current answers if the question keeps no log.
+    template <class Fn>
+    void for_each_change_since(uint64_t since, Fn&& fn) const {
+        if (!config_.history) {
+            for_each_latest_since(since, fn);
+            return;
+        }
+        size_t i = log_.index_after(since);
+        log_.for_each(i, [&](const ResponseRecord& r) {
+            fn(r.student, r.answer, log_.seq_of(i));
+            ++i;
+        });
+    }
+
+    std::string decode(uint32_t answer) const { return decode_answer(config_.type, answer, text_); }
+
+    const QuestionConfig& config() const { return config_; }
+    uint16_t poll() const { return poll_; }
+    // Highest sequence number handed to a change of this question.
+    uint64_t last_seq() const { return last_seq_; }
+    const LatestAnswers& latest() const { return latest_; }
+    const ResponseLog& log() const { return log_; }
+    // Answer texts, indexed as in encoded answers.
+    const StringTable& text() const { return text_; }
+    const ChoiceTally& tally() const { return tally_; }
+    // Empty for questions that are not decimal or fractional.
+    const NumericStats& numeric() const {
+        static const NumericStats none;
+        return numeric_ ? *numeric_ : none;
+    }
+    const TopKCounter& text_top() const { return text_top_; }
+    const StringTable& text_keys() const { return text_keys_; }
+    const ScoreBoard& marks() const { return marks_; }
+
+private:
+    struct NumericAnswer {
+        Rational value;
+        bool valid = false;
+    };
+
+    // Parsed value of an encoded answer, or nullptr if it is not a number.
+    const Rational* numeric_value(uint32_t code) {
+        if (code == LatestAnswers::kNone || !(code & kTextAnswer)) return nullptr;
+        uint32_t id = code & ~kTextAnswer;
+        while (numeric_text_.size() <= id) {
+            NumericAnswer n;
+            n.valid = parse_numeric_answer(text_.str((uint32_t)numeric_text_.size()).c_str(), n.value);
+            numeric_text_.push_back(n);
+        }
+        return numeric_text_[id].valid ? &numeric_text_[id].value : nullptr;
+    }
+
+    // Match key of an encoded short-text answer, or kNone.
+    uint32_t text_key(uint32_t code) {
+        if (code == LatestAnswers::kNone || !(code & kTextAnswer)) return LatestAnswers::kNone;
+        uint32_t id = code & ~kTextAnswer;
+        while (text_key_of_.size() <= id) {
+            const std::string& raw = text_.str((uint32_t)text_key_of_.size());
+            text_key_of_.push_back(text_keys_.intern(normalize_text_answer(raw, config_.text_match)));
+        }
+        return text_key_of_[id];
+    }
+
+    // Moves a student's vote in the top-K index from the previous answer's
+    // key to the new one's.
+    void update_text_top(uint32_t prev, uint32_t answer) {
+        uint32_t from = text_key(prev), to = text_key(answer);
+        if (from == to) return;
+        if (from != LatestAnswers::kNone) text_top_.decrement(from);
+        if (to != LatestAnswers::kNone) text_top_.increment(to);
+    }
+
+    ScoreBoard::Mark answer_mark(uint32_t code) {
+        if (code == LatestAnswers::kNone) return ScoreBoard::kUnanswered;
+        if (!(code & kTextAnswer)) return code == config_.key.mask ? ScoreBoard::kCorrect : ScoreBoard::kIncorrect;
+        uint32_t id = code & ~kTextAnswer;
+        while (text_marks_.size() <= id) {
+            uint32_t text = kTextAnswer | (uint32_t)text_marks_.size();
+            bool correct = false;
+            if (is_numeric_question(config_.type)) {
+                const Rational* v = numeric_value(text);
+                correct = v && v->num == config_.key.value.num && v->den == config_.key.value.den;
+            } else if (config_.type == SMARTRESPONSE_QUESTIONTYPE_SHORTTEXT) {
+                correct = text_keys_.str(text_key(text)) == config_.key.text;
+            }
+            text_marks_.push_back(correct ? ScoreBoard::kCorrect : ScoreBoard::kIncorrect);
+        }
+        return (ScoreBoard::Mark)text_marks_[id];
+    }
+
+    QuestionConfig config_;
+    uint16_t poll_ = 0;
+    uint64_t last_seq_ = 0;
+    LatestAnswers latest_;
+    ResponseLog log_;
+    StringTable text_;                       // interned non-choice answers
+    ChoiceTally tally_;
+    bool tally_deferred_ = false;
+    std::unique_ptr<NumericStats> numeric_;     // decimal and fractional questions only; ~17 KB of sketch
+    std::vector<NumericAnswer> numeric_text_;   // answer text id -> parsed value, filled lazily
+    StringTable text_keys_;
+    std::vector<uint32_t> text_key_of_;      // answer text id -> match key id, filled lazily
+    TopKCounter text_top_;
+    std::vector<uint8_t> text_marks_;        // answer text id -> mark, filled lazily
+    ScoreBoard marks_;
+};
+
+#endif
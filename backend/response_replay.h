@@ -0,0 +1,201 @@
+// Paced replay of recorded responses, and the latency histogram it reports.
+//
+// ResponseReplay feeds a recorded trace of ReplayEvents to a callback on
+// its own thread, keeping the recorded gaps between them scaled by 1/speed
+// (speed 1 reproduces the original timing) or, at max speed, sending them
+// back to back. Gaps longer than max_gap_us are cut to max_gap_us first,
+// so the idle minutes between polls do not dominate a run.
+//
+// LatencyHistogram counts durations in log-linear buckets (kSubBuckets
+// per power of two, so quantiles are within about 12%) with relaxed
+// atomics; recording is wait-free and can run beside a reader.
+
+#ifndef RESPONSE_REPLAY_H
+#define RESPONSE_REPLAY_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A recorded response or, for replays that rebuild the recorded polls,
+// the start or stop of one or a change to its answer key.
+struct ReplayEvent {
+    enum Kind : uint8_t { kResponse, kStart, kStop, kKey };
+    Kind kind = kResponse;
+    uint64_t at_us = 0;             // recorded arrival time
+    uint16_t poll = 0;              // recorded poll or quiz number
+    bool quiz = false;              // kStart
+    std::string id;
+    std::string question_id;
+    std::string answer;             // kStart: the start body; kKey: the key
+    double points = 0;              // kKey
+};
+
+class LatencyHistogram {
+public:
+    static constexpr int kSubBuckets = 8;               // bucket() assumes 2^3
+    static constexpr int kBuckets = 40 * kSubBuckets;   // up to ~2^40 us
+
+    void record(uint64_t us, uint64_t at_us) {
+        counts_[bucket(us)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (us > max && !max_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+        }
+        last_at_us_.store(at_us, std::memory_order_relaxed);
+    }
+
+    // Not atomic with respect to concurrent record() calls.
+    void reset() {
+        for (auto& c : counts_) c.store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+        last_at_us_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    // When the last duration was recorded (caller's clock).
+    uint64_t last_at_us() const { return last_at_us_.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the q-quantile; 0 if empty.
+    uint64_t quantile(double q) const {
+        uint64_t total = count();
+        if (!total) return 0;
+        uint64_t rank = (uint64_t)(q * (double)(total - 1)) + 1, seen = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+            seen += counts_[b].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(upper(b), max());
+        }
+        return max();
+    }
+
+private:
+    // Values below kSubBuckets get a bucket each; above, each power of two
+    // is split into kSubBuckets equal parts.
+    static int bucket(uint64_t v) {
+        if (v < kSubBuckets) return (int)v;
+        int log = 3;                    // v >= kSubBuckets == 2^3
+        while (v >> (log + 1)) ++log;
+        int sub = (int)((v >> (log - 3)) & (kSubBuckets - 1));
+        return std::min((log - 2) * kSubBuckets + sub, kBuckets - 1);
+    }
+    static uint64_t upper(int b) {
+        if (b < kSubBuckets) return (uint64_t)b;
+        int log = b / kSubBuckets + 2, sub = b % kSubBuckets;
+        return ((uint64_t)(kSubBuckets + sub + 1) << (log - 3)) - 1;
+    }
+
+    std::atomic<uint64_t> counts_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> max_{0};
+    std::atomic<uint64_t> last_at_us_{0};
+};
+
+class ResponseReplay {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        double speed = 1;               // 0: max speed
+        uint64_t max_gap_us = UINT64_MAX;
+    };
+
+    struct Status {
+        bool running = false;
+        size_t total = 0;
+        size_t sent = 0;
+        double speed = 1;
+        uint64_t started_us = 0;        // caller's clock, as passed to start()
+        uint64_t elapsed_us = 0;        // sending time so far, or of the whole run
+    };
+
+    ResponseReplay() = default;
+    ResponseReplay(const ResponseReplay&) = delete;
+    ResponseReplay& operator=(const ResponseReplay&) = delete;
+    ~ResponseReplay() { stop(); }
+
+    // Starts sending events in order, calling feed on the replay thread.
+    // False if a replay is already running.
+    bool start(std::vector<ReplayEvent> events, Options options, uint64_t now_us, std::function<void(ReplayEvent&)> feed) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_.load()) return false;
+        if (thread_.joinable()) thread_.join();
+        events_ = std::move(events);
+        options_ = options;
+        feed_ = std::move(feed);
+        sent_.store(0);
+        started_us_ = now_us;
+        started_ = Clock::now();
+        finished_ = started_;
+        cancel_.store(false);
+        running_.store(true);
+        thread_ = std::thread(&ResponseReplay::run, this);
+        return true;
+    }
+
+    // Cancels a running replay and waits for its thread, which wakes from
+    // any gap it is waiting out.
+    void stop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        {
+            std::lock_guard<std::mutex> wait_lock(wait_mutex_);
+            cancel_.store(true);
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    Status status() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Status st;
+        st.running = running_.load();
+        st.total = events_.size();
+        st.sent = sent_.load();
+        st.speed = options_.speed;
+        st.started_us = started_us_;
+        Clock::time_point end = st.running ? Clock::now() : finished_.load();
+        st.elapsed_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(end - started_).count();
+        return st;
+    }
+
+private:
+    void run() {
+        uint64_t offset_us = 0;         // scaled trace time of the current event
+        for (size_t i = 0; i < events_.size() && !cancel_.load(std::memory_order_relaxed); ++i) {
+            if (i && options_.speed > 0) {
+                uint64_t gap = events_[i].at_us > events_[i - 1].at_us ? events_[i].at_us - events_[i - 1].at_us : 0;
+                offset_us += (uint64_t)((double)std::min(gap, options_.max_gap_us) / options_.speed);
+                std::unique_lock<std::mutex> wait_lock(wait_mutex_);
+                if (wake_.wait_until(wait_lock, started_ + std::chrono::microseconds(offset_us), [&] { return cancel_.load(); })) break;
+            }
+            feed_(events_[i]);
+            sent_.store(i + 1, std::memory_order_relaxed);
+        }
+        finished_.store(Clock::now());
+        running_.store(false);
+    }
+
+    std::mutex mutex_;                  // serializes start / stop / status
+    std::mutex wait_mutex_;             // with wake_, for waiting out gaps; stop() holds mutex_ while joining
+    std::condition_variable wake_;
+    std::thread thread_;
+    std::vector<ReplayEvent> events_;
+    Options options_;
+    std::function<void(ReplayEvent&)> feed_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> cancel_{false};
+    std::atomic<size_t> sent_{0};
+    uint64_t started_us_ = 0;
+    Clock::time_point started_;
+    std::atomic<Clock::time_point> finished_{};
+};
+
+#endif
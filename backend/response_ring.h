@@ -0,0 +1,107 @@
+// Bounded lock-free multi-producer/single-consumer ring for clicker responses.
+//
+// The SDK response callback copies each response into a fixed-size slot and
+// returns; it never allocates and never takes a lock. A single consumer thread
+// drains the ring and applies the records to result state. When the ring is
+// full the response is dropped and counted rather than blocking the SDK.
+//
+// Slot hand-off uses a per-cell sequence number (Vyukov's bounded queue):
+// a producer claims a position with a CAS on the head, fills the cell and
+// publishes it by bumping the cell sequence; the consumer owns the tail.
+
+#ifndef RESPONSE_RING_H
+#define RESPONSE_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Fixed-size copy of one SDK response. Strings longer than the field are
+// truncated; NUL termination is always preserved.
+struct RawResponse {
+    char id[64];
+    char question_id[64];
+    char answer[192];
+    uint64_t received_us;   // microseconds, wall-clock scale, steady within a run
+    uint16_t poll;          // question group running when it arrived
+};
+
+template <size_t Capacity>
+class ResponseRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    ResponseRing() {
+        for (size_t i = 0; i < Capacity; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    ResponseRing(const ResponseRing&) = delete;
+    ResponseRing& operator=(const ResponseRing&) = delete;
+
+    // Producer side; safe to call from any number of threads.
+    bool try_push(const char* id, const char* question_id, const char* answer, uint64_t received_us, uint16_t poll) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos & (Capacity - 1)];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (dif < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        copy_field(cell->data.id, sizeof(cell->data.id), id);
+        copy_field(cell->data.question_id, sizeof(cell->data.question_id), question_id);
+        copy_field(cell->data.answer, sizeof(cell->data.answer), answer);
+        cell->data.received_us = received_us;
+        cell->data.poll = poll;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; must only be called from one thread. Invokes fn on up to
+    // max published records in order and returns how many were consumed.
+    template <class Fn>
+    size_t drain(Fn&& fn, size_t max = Capacity) {
+        size_t n = 0;
+        while (n < max) {
+            Cell& cell = cells_[tail_ & (Capacity - 1)];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            if ((intptr_t)seq - (intptr_t)(tail_ + 1) < 0) break;
+            fn(static_cast<const RawResponse&>(cell.data));
+            cell.seq.store(tail_ + Capacity, std::memory_order_release);
+            ++tail_;
+            ++n;
+        }
+        return n;
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        RawResponse data;
+    };
+
+    static void copy_field(char* dst, size_t cap, const char* src) {
+        size_t len = src ? strnlen(src, cap - 1) : 0;
+        if (len) memcpy(dst, src, len);
+        dst[len] = '\0';
+    }
+
+    Cell cells_[Capacity];
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) size_t tail_ = 0;
+    alignas(64) std::atomic<uint64_t> dropped_{0};
+};
+
+#endif
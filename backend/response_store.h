@@ -0,0 +1,222 @@
+// Compact storage for clicker responses.
+//
+// Responses are kept as packed 16-byte ResponseRecords in a chunked arena
+// rather than as JSON text. Student ids and free-form answers are interned
+// once into StringTables and referenced by dense index, so a record holds
+// only integers and JSON is produced at the edge when a client asks.
+
+#ifndef RESPONSE_STORE_H
+#define RESPONSE_STORE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "../headers/question.h"
+
+// Encoded answers: choice-style questions store a bitmask of the selected
+// choices (bit 0 = 'A' / 'Y' / 'T', bit 1 = 'B' / 'N' / 'F', ...). Anything
+// else is interned text and stored as kTextAnswer | string table index.
+static constexpr uint32_t kTextAnswer = 0x80000000u;
+
+struct ResponseRecord {
+    uint32_t student;   // dense index into the student id table
+    uint16_t question;  // poll number within this server run
+    uint16_t flags;
+    uint32_t answer;    // encoded answer, see above
+    uint32_t t_ms;      // milliseconds since the log's epoch
+};
+static_assert(sizeof(ResponseRecord) == 16, "ResponseRecord must stay packed");
+
+// Interns strings to dense indices. Strings live in a deque so the views
+// used as map keys stay valid as the table grows.
+class StringTable {
+public:
+    uint32_t intern(std::string_view s) {
+        auto it = index_.find(s);
+        if (it != index_.end()) return it->second;
+        strings_.emplace_back(s);
+        uint32_t id = (uint32_t)(strings_.size() - 1);
+        index_.emplace(std::string_view(strings_.back()), id);
+        return id;
+    }
+
+    // Returns false if s has not been interned.
+    bool find(std::string_view s, uint32_t& id) const {
+        auto it = index_.find(s);
+        if (it == index_.end()) return false;
+        id = it->second;
+        return true;
+    }
+
+    const std::string& str(uint32_t id) const { return strings_[id]; }
+    size_t size() const { return strings_.size(); }
+
+    void clear() {
+        index_.clear();
+        strings_.clear();
+    }
+
+private:
+    std::deque<std::string> strings_;
+    std::unordered_map<std::string_view, uint32_t> index_;
+};
+
+// Returns true if qtype answers are encoded as a choice bitmask.
+inline bool is_choice_question(int qtype) {
+    return qtype == SMARTRESPONSE_QUESTIONTYPE_MULTIPLECHOICE || qtype == SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER ||
+           qtype == SMARTRESPONSE_QUESTIONTYPE_YESNO || qtype == SMARTRESPONSE_QUESTIONTYPE_TRUEFALSE;
+}
+
+// Returns true if qtype answers are numbers (decimal or fractional).
+inline bool is_numeric_question(int qtype) {
+    return qtype == SMARTRESPONSE_QUESTIONTYPE_DECIMAL || qtype == SMARTRESPONSE_QUESTIONTYPE_FRACTIONAL;
+}
+
+// Maps one answer character to its choice bit, or -1 if it is not valid for qtype.
+inline int choice_bit(int qtype, char c) {
+    switch (qtype) {
+    case SMARTRESPONSE_QUESTIONTYPE_YESNO:
+        return c == 'Y' ? 0 : c == 'N' ? 1 : -1;
+    case SMARTRESPONSE_QUESTIONTYPE_TRUEFALSE:
+        return c == 'T' ? 0 : c == 'F' ? 1 : -1;
+    default:
+        return (c >= 'A' && c <= 'J') ? c - 'A' : -1;
+    }
+}
+
+inline uint32_t encode_answer(int qtype, const char* answer, StringTable& text) {
+    if (is_choice_question(qtype) && answer[0]) {
+        uint32_t mask = 0;
+        const char* p = answer;
+        for (; *p; ++p) {
+            int bit = choice_bit(qtype, *p);
+            if (bit < 0) break;
+            mask |= 1u << bit;
+        }
+        if (!*p) return mask;
+    }
+    return kTextAnswer | text.intern(answer);
+}
+
+inline std::string decode_answer(int qtype, uint32_t code, const StringTable& text) {
+    if (code & kTextAnswer) return text.str(code & ~kTextAnswer);
+    static const char kYesNo[] = "YN";
+    static const char kTrueFalse[] = "TF";
+    std::string out;
+    for (int bit = 0; bit < 10; ++bit) {
+        if (!(code & (1u << bit))) continue;
+        if (qtype == SMARTRESPONSE_QUESTIONTYPE_YESNO) out += kYesNo[bit & 1];
+        else if (qtype == SMARTRESPONSE_QUESTIONTYPE_TRUEFALSE) out += kTrueFalse[bit & 1];
+        else out += (char)('A' + bit);
+    }
+    return out;
+}
+
+// Current answer of every student, indexed by dense student index, with
+// the sequence number and time of its last change as parallel columns.
+// Slots past the roster are added on demand for clickers that are not on it.
+class LatestAnswers {
+public:
+    static constexpr uint32_t kNone = 0xFFFFFFFFu;
+
+    void reset(size_t students) {
+        answers_.assign(students, kNone);
+        seqs_.assign(students, 0);
+        times_.assign(students, 0);
+        answered_ = 0;
+    }
+
+    // Stores answer for student and returns the previous one (kNone if the
+    // student had not answered). seq and t_ms are only recorded if the
+    // answer changed.
+    uint32_t set(uint32_t student, uint32_t answer, uint64_t seq, uint32_t t_ms) {
+        if (student >= answers_.size()) {
+            answers_.resize(student + 1, kNone);
+            seqs_.resize(student + 1, 0);
+            times_.resize(student + 1, 0);
+        }
+        uint32_t prev = answers_[student];
+        if (prev == answer) return prev;
+        answers_[student] = answer;
+        seqs_[student] = seq;
+        times_[student] = t_ms;
+        if (prev == kNone) ++answered_;
+        return prev;
+    }
+
+    uint32_t get(uint32_t student) const { return student < answers_.size() ? answers_[student] : kNone; }
+    // Sequence number of the student's last answer change.
+    uint64_t seq(uint32_t student) const { return student < seqs_.size() ? seqs_[student] : 0; }
+    // Time of the student's last answer change, as ResponseRecord::t_ms.
+    uint32_t t_ms(uint32_t student) const { return student < times_.size() ? times_[student] : 0; }
+    size_t size() const { return answers_.size(); }
+    size_t answered() const { return answered_; }
+    const uint32_t* data() const { return answers_.data(); }
+
+private:
+    std::vector<uint32_t> answers_;
+    std::vector<uint64_t> seqs_;
+    std::vector<uint32_t> times_;
+    size_t answered_ = 0;
+};
+
+// Append-only arena of ResponseRecords in fixed 64 KiB chunks. Appends never
+// move existing records, and iteration walks contiguous arrays. Records carry
+// consecutive sequence numbers starting after the one given to reset().
+class ResponseLog {
+public:
+    static constexpr size_t kChunkRecords = 4096;
+
+    void push_back(const ResponseRecord& r) {
+        size_t slot = size_ % kChunkRecords;
+        if (slot == 0 && size_ / kChunkRecords == chunks_.size())
+            chunks_.emplace_back(new ResponseRecord[kChunkRecords]);
+        chunks_[size_ / kChunkRecords][slot] = r;
+        ++size_;
+    }
+
+    const ResponseRecord& operator[](size_t i) const { return chunks_[i / kChunkRecords][i % kChunkRecords]; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Calls fn on records [from, size()) in order.
+    template <class Fn>
+    void for_each(size_t from, Fn&& fn) const {
+        for (size_t i = from; i < size_;) {
+            const ResponseRecord* chunk = chunks_[i / kChunkRecords].get();
+            size_t end = std::min(size_, (i / kChunkRecords + 1) * kChunkRecords);
+            for (size_t j = i % kChunkRecords; i < end; ++i, ++j) fn(chunk[j]);
+        }
+    }
+
+    // Drops all records and restarts timestamps at epoch_us; the next record
+    // gets sequence number base_seq + 1. The first chunk is kept so a new
+    // poll does not reallocate.
+    void reset(uint64_t epoch_us, uint64_t base_seq) {
+        if (chunks_.size() > 1) chunks_.resize(1);
+        size_ = 0;
+        epoch_us_ = epoch_us;
+        base_seq_ = base_seq;
+    }
+
+    uint64_t seq_of(size_t i) const { return base_seq_ + i + 1; }
+    // Index of the first record with a sequence number greater than seq.
+    size_t index_after(uint64_t seq) const { return seq <= base_seq_ ? 0 : (size_t)std::min<uint64_t>(seq - base_seq_, size_); }
+
+    uint32_t to_ms(uint64_t us) const { return us > epoch_us_ ? (uint32_t)((us - epoch_us_) / 1000) : 0; }
+    uint64_t epoch_us() const { return epoch_us_; }
+
+private:
+    std::vector<std::unique_ptr<ResponseRecord[]>> chunks_;
+    size_t size_ = 0;
+    uint64_t epoch_us_ = 0;
+    uint64_t base_seq_ = 0;
+};
+
+#endif
@@ -0,0 +1,304 @@
+// Streaming roster readers.
+//
+// Each reader turns a roster payload into RosterStudent records one at a
+// time, so a large import never needs a JSON DOM of the whole body:
+//   RosterSaxHandler - {"className": ..., "students": [{...}, ...]} through
+//                      nlohmann::json::sax_parse
+//   CsvRosterReader  - id,first,last lines (RFC 4180 quoting, optional
+//                      header naming the columns in any order)
+//   NdjsonRosterReader - one {"id", "first", "last"} object per line
+// The line-based readers take the body in arbitrary chunks and hold at most
+// one line. Records are numbered from 1 in payload order; a record that is
+// incomplete is reported to the sink's reject() instead of add().
+//
+// A Sink provides:
+//   void class_name(std::string name);
+//   void add(RosterStudent student, size_t record);
+//   void reject(size_t record, std::string_view id, const char* error);
+
+#ifndef ROSTER_IMPORT_H
+#define ROSTER_IMPORT_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+struct RosterStudent {
+    std::string id, first, last;
+};
+
+static constexpr size_t kMaxRosterLine = 4096;
+
+// Passes a record to the sink, or rejects it if a field is missing.
+template <class Sink>
+void emit_roster_student(Sink& sink, RosterStudent& st, size_t record) {
+    if (st.id.empty() || st.first.empty() || st.last.empty()) sink.reject(record, st.id, "id, first and last are required");
+    else sink.add(std::move(st), record);
+}
+
+template <class Sink>
+class RosterSaxHandler : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit RosterSaxHandler(Sink& sink) : sink_(sink) {}
+
+    bool saw_students() const { return saw_students_; }
+    const std::string& error() const { return error_; }
+
+    bool start_object(std::size_t) override {
+        ++depth_;
+        if (in_students_ && depth_ == 3) {
+            student_ = RosterStudent();
+            bad_field_ = nullptr;
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        if (in_students_ && depth_ == 3) {
+            ++record_;
+            if (bad_field_) sink_.reject(record_, student_.id, bad_field_);
+            else emit_roster_student(sink_, student_, record_);
+        }
+        --depth_;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        ++depth_;
+        if (depth_ == 2 && key_ == "students") in_students_ = saw_students_ = true;
+        return true;
+    }
+
+    bool end_array() override {
+        if (depth_ == 2) in_students_ = false;
+        --depth_;
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        key_ = val;
+        return true;
+    }
+
+    bool string(string_t& val) override {
+        if (depth_ == 1 && key_ == "className") {
+            sink_.class_name(val);
+        } else if (std::string* field = student_field()) {
+            *field = std::move(val);
+        }
+        return true;
+    }
+
+    bool null() override { return value(); }
+    bool boolean(bool) override { return value(); }
+    bool number_integer(number_integer_t) override { return value(); }
+    bool number_unsigned(number_unsigned_t) override { return value(); }
+    bool number_float(number_float_t, const string_t&) override { return value(); }
+    bool binary(binary_t&) override { return value(); }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override {
+        error_ = "Malformed JSON at byte " + std::to_string(position) + " (record " + std::to_string(record_ + 1) + "): " + ex.what();
+        return false;
+    }
+
+private:
+    // The field of the current student that the current key names, if any.
+    std::string* student_field() {
+        if (!in_students_ || depth_ != 3) return nullptr;
+        if (key_ == "id") return &student_.id;
+        if (key_ == "first") return &student_.first;
+        if (key_ == "last") return &student_.last;
+        return nullptr;
+    }
+
+    // Non-string scalars: className and student fields must be strings.
+    bool value() {
+        if (student_field()) bad_field_ = "id, first and last must be strings";
+        else if (depth_ == 1 && key_ == "className") error_ = "className must be a string";
+        return error_.empty();
+    }
+
+    Sink& sink_;
+    int depth_ = 0;
+    bool in_students_ = false;
+    bool saw_students_ = false;
+    std::string key_;
+    RosterStudent student_;
+    const char* bad_field_ = nullptr;
+    size_t record_ = 0;
+    std::string error_;
+};
+
+// Splits a chunked body into lines for the line-based readers. Lines longer
+// than kMaxRosterLine are dropped and reported through on_line's second
+// argument rather than buffered.
+class LineSplitter {
+public:
+    template <class OnLine>
+    void feed(const char* data, size_t len, OnLine&& on_line) {
+        for (size_t i = 0; i < len; ++i) {
+            char c = data[i];
+            if (c == '\n') {
+                end_line(on_line);
+            } else if (line_.size() < kMaxRosterLine) {
+                line_ += c;
+            } else {
+                overflow_ = true;
+            }
+        }
+    }
+
+    template <class OnLine>
+    void finish(OnLine&& on_line) {
+        if (!line_.empty() || overflow_) end_line(on_line);
+    }
+
+private:
+    template <class OnLine>
+    void end_line(OnLine& on_line) {
+        if (!line_.empty() && line_.back() == '\r') line_.pop_back();
+        on_line(line_, overflow_);
+        line_.clear();
+        overflow_ = false;
+    }
+
+    std::string line_;
+    bool overflow_ = false;
+};
+
+template <class Sink>
+class CsvRosterReader {
+public:
+    explicit CsvRosterReader(Sink& sink) : sink_(sink) {}
+
+    void feed(const char* data, size_t len) {
+        lines_.feed(data, len, [&](const std::string& line, bool overflow) { on_line(line, overflow); });
+    }
+
+    void finish() {
+        lines_.finish([&](const std::string& line, bool overflow) { on_line(line, overflow); });
+    }
+
+private:
+    void on_line(const std::string& line, bool overflow) {
+        if (line.empty() && !overflow) return;
+        if (overflow) {
+            sink_.reject(++record_, {}, "line too long");
+            return;
+        }
+        std::vector<std::string> fields;
+        if (!split(line, fields)) {
+            sink_.reject(++record_, {}, "unterminated quote");
+            return;
+        }
+        if (first_line_) {
+            first_line_ = false;
+            if (read_header(fields)) return;
+        }
+        RosterStudent st;
+        std::string* out[] = {&st.id, &st.first, &st.last};
+        for (int i = 0; i < 3; ++i)
+            if (columns_[i] < fields.size()) *out[i] = std::move(fields[columns_[i]]);
+        emit_roster_student(sink_, st, ++record_);
+    }
+
+    // A first line naming the id, first and last columns sets their order.
+    bool read_header(const std::vector<std::string>& fields) {
+        static const char* kNames[] = {"id", "first", "last"};
+        size_t found[3] = {kNone, kNone, kNone};
+        for (size_t f = 0; f < fields.size(); ++f)
+            for (int i = 0; i < 3; ++i)
+                if (fields[f] == kNames[i]) found[i] = f;
+        if (found[0] == kNone) return false;
+        for (int i = 0; i < 3; ++i) columns_[i] = found[i];
+        return true;
+    }
+
+    // RFC 4180 fields: "..." may contain commas, and "" is a literal quote.
+    // Quoted line breaks are not supported.
+    static bool split(const std::string& line, std::vector<std::string>& fields) {
+        fields.emplace_back();
+        bool quoted = false;
+        for (size_t i = 0; i < line.size(); ++i) {
+            char c = line[i];
+            if (quoted) {
+                if (c != '"') fields.back() += c;
+                else if (i + 1 < line.size() && line[i + 1] == '"') fields.back() += line[++i];
+                else quoted = false;
+            } else if (c == '"') {
+                quoted = true;
+            } else if (c == ',') {
+                fields.emplace_back();
+            } else {
+                fields.back() += c;
+            }
+        }
+        for (auto& f : fields) trim(f);
+        return !quoted;
+    }
+
+    static void trim(std::string& s) {
+        size_t b = s.find_first_not_of(" \t"), e = s.find_last_not_of(" \t");
+        s = b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+    }
+
+    static constexpr size_t kNone = ~size_t(0);
+
+    Sink& sink_;
+    LineSplitter lines_;
+    size_t columns_[3] = {0, 1, 2};
+    bool first_line_ = true;
+    size_t record_ = 0;
+};
+
+template <class Sink>
+class NdjsonRosterReader {
+public:
+    explicit NdjsonRosterReader(Sink& sink) : sink_(sink) {}
+
+    void feed(const char* data, size_t len) {
+        lines_.feed(data, len, [&](const std::string& line, bool overflow) { on_line(line, overflow); });
+    }
+
+    void finish() {
+        lines_.finish([&](const std::string& line, bool overflow) { on_line(line, overflow); });
+    }
+
+private:
+    void on_line(const std::string& line, bool overflow) {
+        if (line.find_first_not_of(" \t") == std::string::npos && !overflow) return;
+        ++record_;
+        if (overflow) {
+            sink_.reject(record_, {}, "line too long");
+            return;
+        }
+        // One line is one small object, so a DOM per line stays bounded.
+        nlohmann::json j = nlohmann::json::parse(line, nullptr, false);
+        if (!j.is_object()) {
+            sink_.reject(record_, {}, "not a JSON object");
+            return;
+        }
+        RosterStudent st;
+        std::string* out[] = {&st.id, &st.first, &st.last};
+        static const char* kNames[] = {"id", "first", "last"};
+        for (int i = 0; i < 3; ++i) {
+            auto it = j.find(kNames[i]);
+            if (it == j.end()) continue;
+            if (!it->is_string()) {
+                sink_.reject(record_, st.id, "id, first and last must be strings");
+                return;
+            }
+            *out[i] = it->get<std::string>();
+        }
+        emit_roster_student(sink_, st, record_);
+    }
+
+    Sink& sink_;
+    LineSplitter lines_;
+    size_t record_ = 0;
+};
+
+#endif
@@ -0,0 +1,130 @@
+// Student id -> dense index map for the response path.
+//
+// Ids and names live back to back in one contiguous character pool; the
+// index is a flat open-addressing table (linear probing, power-of-two
+// capacity) of {hash, index} pairs. Resolving a clicker id is one hash and,
+// normally, one probe and one memcmp against the pool, with no allocation.
+// Dense indices are handed out in insertion order (roster first, then
+// clickers not on the roster), so every per-student structure can be a
+// plain array indexed by them.
+
+#ifndef ROSTER_INDEX_H
+#define ROSTER_INDEX_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RosterIndex {
+public:
+    static constexpr uint32_t kNone = 0xFFFFFFFFu;
+
+    void clear() {
+        pool_.clear();
+        names_.clear();
+        slots_.assign(slots_.empty() ? 0 : kMinSlots, Slot{0, kNone});
+    }
+
+    // Sizes the table and pool for students entries without rehashing.
+    void reserve(size_t students, size_t pool_bytes = 0) {
+        names_.reserve(students);
+        pool_.reserve(pool_bytes);
+        size_t want = kMinSlots;
+        while (want < students * 2) want *= 2;
+        if (want > slots_.size()) rehash(want);
+    }
+
+    // Returns the index of id, or kNone.
+    uint32_t find(std::string_view id) const {
+        if (slots_.empty()) return kNone;
+        uint32_t h = hash(id);
+        size_t mask = slots_.size() - 1;
+        for (size_t i = h & mask;; i = (i + 1) & mask) {
+            const Slot& s = slots_[i];
+            if (s.index == kNone) return kNone;
+            if (s.hash == h && this->id(s.index) == id) return s.index;
+        }
+    }
+
+    // Returns the index of id, adding it with the given names if it is new.
+    uint32_t intern(std::string_view id, std::string_view first = {}, std::string_view last = {}) {
+        uint32_t index = find(id);
+        return index != kNone ? index : insert(id, first, last);
+    }
+
+    // Replaces the names of an existing entry; its id and index are kept.
+    // The old names stay in the pool until clear().
+    void rename(uint32_t index, std::string_view first, std::string_view last) {
+        std::string id(this->id(index));
+        names_[index] = append(id, first, last);
+    }
+
+    std::string_view id(uint32_t index) const { return field(names_[index].id, names_[index].first); }
+    std::string_view first(uint32_t index) const { return field(names_[index].first, names_[index].last); }
+    std::string_view last(uint32_t index) const { return field(names_[index].last, names_[index].end); }
+    size_t size() const { return names_.size(); }
+
+private:
+    static constexpr size_t kMinSlots = 16;
+
+    struct Slot {
+        uint32_t hash;
+        uint32_t index;   // kNone marks an empty slot
+    };
+
+    // Offsets into pool_: id, first and last name are stored back to back.
+    struct Names {
+        uint32_t id, first, last, end;
+    };
+
+    static uint32_t hash(std::string_view s) {
+        uint32_t h = 2166136261u;   // FNV-1a
+        for (unsigned char c : s) h = (h ^ c) * 16777619u;
+        return h;
+    }
+
+    std::string_view field(uint32_t from, uint32_t to) const { return std::string_view(pool_.data() + from, to - from); }
+
+    uint32_t insert(std::string_view id, std::string_view first, std::string_view last) {
+        if ((names_.size() + 1) * 2 > slots_.size()) rehash(slots_.empty() ? kMinSlots : slots_.size() * 2);
+        uint32_t index = (uint32_t)names_.size();
+        names_.push_back(append(id, first, last));
+        place(hash(id), index);
+        return index;
+    }
+
+    Names append(std::string_view id, std::string_view first, std::string_view last) {
+        Names n;
+        n.id = (uint32_t)pool_.size();
+        pool_.append(id);
+        n.first = (uint32_t)pool_.size();
+        pool_.append(first);
+        n.last = (uint32_t)pool_.size();
+        pool_.append(last);
+        n.end = (uint32_t)pool_.size();
+        return n;
+    }
+
+    void place(uint32_t h, uint32_t index) {
+        size_t mask = slots_.size() - 1;
+        size_t i = h & mask;
+        while (slots_[i].index != kNone) i = (i + 1) & mask;
+        slots_[i] = Slot{h, index};
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.assign(capacity, Slot{0, kNone});
+        for (const Slot& s : old)
+            if (s.index != kNone) place(s.hash, s.index);
+    }
+
+    std::string pool_;
+    std::vector<Names> names_;
+    std::vector<Slot> slots_;
+};
+
+#endif
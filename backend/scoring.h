@@ -0,0 +1,111 @@
+// Correctness scoring against a question's answer key.
+//
+// Each student's current answer is marked correct or incorrect as it is
+// ingested, so the correct count and percent-correct are read in O(1).
+// When the key changes mid-poll the marks are recomputed in one pass over
+// the latest-answer column. Points of finished polls and quizzes are banked
+// per student in ScoreTotals.
+
+#ifndef SCORING_H
+#define SCORING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class ScoreBoard {
+public:
+    enum Mark : uint8_t { kUnanswered = 0, kIncorrect = 1, kCorrect = 2 };
+
+    // Forgets every mark; the question is worth points if scored.
+    void reset(size_t students, bool scored, double points) {
+        marks_.assign(students, kUnanswered);
+        scored_ = scored;
+        points_ = points;
+        answered_ = correct_ = 0;
+    }
+
+    void set(uint32_t student, Mark mark) {
+        grow(student + 1);
+        Mark prev = (Mark)marks_[student];
+        answered_ += (mark != kUnanswered) - (prev != kUnanswered);
+        correct_ += (mark == kCorrect) - (prev == kCorrect);
+        marks_[student] = mark;
+    }
+
+    // Recomputes every mark; mark_of(i) gives the mark
+    // of student i for i in [0, students).
+    template <class MarkOf>
+    void rescore(bool scored, double points, size_t students, MarkOf&& mark_of) {
+        grow(students);
+        scored_ = scored;
+        points_ = points;
+        int64_t answered = 0, correct = 0;
+        for (size_t i = 0; i < students; ++i) {
+            Mark m = mark_of((uint32_t)i);
+            marks_[i] = m;
+            answered += m != kUnanswered;
+            correct += m == kCorrect;
+        }
+        answered_ = answered;
+        correct_ = correct;
+    }
+
+    bool scored() const { return scored_; }
+    double points() const { return points_; }
+    int64_t answered() const { return answered_; }
+    int64_t correct() const { return correct_; }
+    size_t size() const { return marks_.size(); }
+    Mark mark(uint32_t student) const { return student < marks_.size() ? (Mark)marks_[student] : kUnanswered; }
+
+private:
+    void grow(size_t n) {
+        if (n > marks_.size()) marks_.resize(n, kUnanswered);
+    }
+
+    std::vector<uint8_t> marks_;
+    bool scored_ = false;
+    double points_ = 0;
+    int64_t answered_ = 0;
+    int64_t correct_ = 0;
+};
+
+// Points banked per student from finished questions.
+class ScoreTotals {
+public:
+    void reset() {
+        points_.clear();
+        possible_ = 0;
+    }
+
+    // Adds (sign 1) or takes back (sign -1) the points of a question's marks.
+    void bank(const ScoreBoard& marks, int sign = 1) {
+        if (!marks.scored()) return;
+        for (uint32_t i = 0; i < (uint32_t)marks.size(); ++i)
+            if (marks.mark(i) == ScoreBoard::kCorrect) add(i, sign * marks.points());
+        possible_ += sign * marks.points();
+    }
+
+    // Applies a change to an already banked question.
+    void add(uint32_t student, double points) {
+        if (points_.size() <= student) points_.resize(student + 1, 0);
+        points_[student] += points;
+    }
+
+    double points(uint32_t student) const { return student < points_.size() ? points_[student] : 0; }
+    double possible() const { return possible_; }
+    size_t size() const { return points_.size(); }
+
+    // Replaces the totals, as read back from a snapshot.
+    void assign(std::vector<double> points, double possible) {
+        points_ = std::move(points);
+        possible_ = possible;
+    }
+
+private:
+    std::vector<double> points_;
+    double possible_ = 0;
+};
+
+#endif
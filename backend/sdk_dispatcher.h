@@ -0,0 +1,105 @@
+// The thread that owns the SDK.
+//
+// Connections are created with SMARTRESPONSE_INVOKE_CALLBACKS_ON_MAIN_THREAD_ONLY,
+// so their callbacks are delivered only while the main thread runs the
+// SDK's event loop. The main thread therefore runs SdkDispatcher::run()
+// and the HTTP server runs on another thread. run() alternates between
+// executing queued commands and smartresponse_condition_wait, which pumps
+// the event loop (and with it the clicker callbacks) until a command is
+// queued or kIdleWait passes. Request threads hand every call that
+// touches a connection to the dispatcher with call(), which blocks until
+// it has run, or post(), which does not.
+//
+// Commands run while their submitter waits and may use state the submitter
+// has locked, but must not take a lock themselves: a submitter may hold a
+// session mutex while it waits.
+
+#ifndef SDK_DISPATCHER_H
+#define SDK_DISPATCHER_H
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "../headers/smartresponsesdk.h"
+
+class SdkDispatcher {
+public:
+    // The condition wait does not latch a notify that comes before it, so a
+    // command can wait up to kIdleWait (seconds) to be picked up.
+    static constexpr double kIdleWait = 0.005;
+
+    // Makes the calling thread the dispatcher; call after the SDK is
+    // initialized and before any other thread submits commands. Until
+    // run() starts, commands queue up.
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wake_ = smartresponse_condition_create();
+        owner_ = std::this_thread::get_id();
+        running_ = true;
+    }
+
+    // Runs commands and SDK callbacks until stop().
+    void run() {
+        for (;;) {
+            std::deque<std::function<void()>> commands;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                commands.swap(queue_);
+                if (commands.empty() && stopping_) {
+                    running_ = false;
+                    break;
+                }
+            }
+            for (auto& command : commands) command();
+            if (commands.empty()) smartresponse_condition_wait(wake_, kIdleWait);
+        }
+        smartresponse_condition_release(wake_);
+        wake_ = nullptr;
+    }
+
+    // Makes run() return once the queue is empty. Commands submitted after
+    // that run on the submitting thread.
+    void stop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        if (wake_) smartresponse_condition_notify(wake_);
+    }
+
+    // Runs fn on the dispatcher and returns its result, rethrowing what it
+    // throws. Runs fn directly when called on the dispatcher itself.
+    template <class Fn>
+    auto call(Fn&& fn) -> decltype(fn()) {
+        using Result = decltype(fn());
+        if (std::this_thread::get_id() == owner_) return fn();
+        std::packaged_task<Result()> task(std::forward<Fn>(fn));
+        std::future<Result> done = task.get_future();
+        if (!enqueue([&task] { task(); })) task();
+        return done.get();
+    }
+
+    // Queues fn without waiting for it.
+    void post(std::function<void()> fn) {
+        if (!enqueue(fn)) fn();
+    }
+
+private:
+    bool enqueue(std::function<void()> fn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return false;
+        queue_.push_back(std::move(fn));
+        if (wake_) smartresponse_condition_notify(wake_);
+        return true;
+    }
+
+    std::mutex mutex_;
+    std::deque<std::function<void()>> queue_;
+    smartresponse_condition_t* wake_ = nullptr;
+    std::thread::id owner_;
+    bool running_ = false;
+    bool stopping_ = false;
+};
+
+#endif
@@ -0,0 +1,50 @@
+// Immutable serialized replies shared across concurrent readers.
+//
+// A snapshot is tagged with the result version it was built for and the
+// generation of the state it renders (the roster, say), which must match
+// exactly. Readers that ask for a version the cache already covers get the
+// same shared buffer; when it is stale exactly one reader rebuilds it while the others
+// wait for that build instead of serializing the same state themselves.
+
+#ifndef SNAPSHOT_CACHE_H
+#define SNAPSHOT_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class SnapshotCache {
+public:
+    using Snapshot = std::shared_ptr<const std::string>;
+
+    // Returns a snapshot of generation at least as new as version, calling
+    // build() to produce one if needed. build must serialize state that is
+    // no older than version.
+    template <class Build>
+    Snapshot get(uint64_t generation, uint64_t version, Build&& build) {
+        if (Snapshot s = lookup(generation, version)) return s;
+        std::lock_guard<std::mutex> building(build_mutex_);
+        if (Snapshot s = lookup(generation, version)) return s;
+        Snapshot s = std::make_shared<const std::string>(build());
+        std::lock_guard<std::mutex> lock(mutex_);
+        snapshot_ = s;
+        generation_ = generation;
+        version_ = version;
+        return s;
+    }
+
+private:
+    Snapshot lookup(uint64_t generation, uint64_t version) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return snapshot_ && generation_ == generation && version_ >= version ? snapshot_ : nullptr;
+    }
+
+    mutable std::mutex mutex_;
+    std::mutex build_mutex_;
+    Snapshot snapshot_;
+    uint64_t generation_ = 0;
+    uint64_t version_ = 0;
+};
+
+#endif
@@ -0,0 +1,107 @@
+// Incremental per-choice counters for choice-style questions.
+//
+// The tally is shaped once from the question (type and choice count) and is
+// updated by +1/-1 as encoded answers arrive or are replaced, so reading it
+// costs O(choices) regardless of how many responses were received.
+
+#ifndef TALLY_H
+#define TALLY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "response_store.h"
+#include "bitmask_histogram.h"
+
+class ChoiceTally {
+public:
+    static constexpr int kMaxChoices = 10;
+
+    // Resets all counters and shapes the tally for a question. For
+    // multiple-answer questions exact-combination counts are kept as well.
+    void reset(int qtype, int choice_count) {
+        qtype_ = qtype;
+        choices_ = is_choice_question(qtype) ? std::min(std::max(choice_count, 0), kMaxChoices) : 0;
+        for (auto& c : counts_) c = 0;
+        responses_ = 0;
+        other_ = 0;
+        if (qtype == SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER) {
+            combos_.assign(size_t(1) << choices_, 0);
+            sizes_.assign(choices_ + 1, 0);
+        } else {
+            combos_.clear();
+            sizes_.clear();
+        }
+    }
+
+    // Recomputes every counter from a column of current answers (one entry
+    // per student, LatestAnswers::kNone for no answer) with the bulk kernels.
+    void rebuild(const uint32_t* answers, size_t n) {
+        reset(qtype_, choices_);
+        if (choices_ > 0) {
+            ChoiceBitCounts bits = count_choice_bits(answers, n, choices_, qtype_ != SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER);
+            for (int i = 0; i < choices_; ++i) counts_[i] = bits.per_choice[i];
+            responses_ = bits.answered;
+            other_ = bits.answered - bits.valid;
+            if (!combos_.empty()) count_combinations(answers, n, choices_, combos_.data(), sizes_.data());
+            return;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (answers[i] != LatestAnswers::kNone) ++responses_;
+        }
+        other_ = responses_;
+    }
+
+    void add(uint32_t code) { apply(code, 1); }
+    void remove(uint32_t code) { apply(code, -1); }
+
+    int qtype() const { return qtype_; }
+    int choice_count() const { return choices_; }
+    int64_t responses() const { return responses_; }
+    // Responses that are not a valid selection for this question.
+    int64_t other() const { return other_; }
+    int64_t count(int choice) const { return counts_[choice]; }
+    // Number of responses that selected exactly the choices in mask
+    // (multiple-answer questions only).
+    int64_t combination(uint32_t mask) const { return mask < combos_.size() ? combos_[mask] : 0; }
+    size_t combination_slots() const { return combos_.size(); }
+    // Number of responses that selected exactly k choices (multiple-answer
+    // questions only).
+    int64_t selections(int k) const { return k < (int)sizes_.size() ? sizes_[k] : 0; }
+
+private:
+    bool valid(uint32_t code) const {
+        if (code & kTextAnswer) return false;
+        if (code == 0 || code >> choices_) return false;
+        // Single-selection questions must have exactly one bit set.
+        return qtype_ == SMARTRESPONSE_QUESTIONTYPE_MULTIPLEANSWER || (code & (code - 1)) == 0;
+    }
+
+    void apply(uint32_t code, int delta) {
+        responses_ += delta;
+        if (!valid(code)) {
+            other_ += delta;
+            return;
+        }
+        int selected = 0;
+        for (uint32_t m = code; m; m &= m - 1, ++selected) {
+            int bit = 0;
+            while (!(m & (1u << bit))) ++bit;
+            counts_[bit] += delta;
+        }
+        if (!combos_.empty()) {
+            combos_[code] += delta;
+            sizes_[selected] += delta;
+        }
+    }
+
+    int qtype_ = 0;
+    int choices_ = 0;
+    int64_t counts_[kMaxChoices] = {};
+    int64_t responses_ = 0;
+    int64_t other_ = 0;
+    std::vector<int64_t> combos_;
+    std::vector<int64_t> sizes_;
+};
+
+#endif
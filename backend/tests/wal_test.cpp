@@ -0,0 +1,285 @@
+// Tests for the write-ahead log in wal.h: record framing, torn and corrupt
+// logs, snapshot replacement and commit failures. Run by ctest; exits
+// non-zero if a check fails.
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../wal.h"
+#ifndef _WIN32
+#include <csignal>
+#include <sys/resource.h>
+#endif
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                               \
+    do {                                                                          \
+        if (!(cond)) {                                                            \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++g_failures;                                                         \
+        }                                                                         \
+    } while (0)
+
+static std::string temp_path(const char* name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+struct TestRecord {
+    uint8_t type;
+    uint64_t at_us;
+    uint64_t n;
+    std::string s;
+    double d;
+};
+
+// Varints of every length, strings with NULs, and timestamps that go
+// backwards (negative zigzag deltas).
+static std::vector<TestRecord> sample_records() {
+    std::vector<TestRecord> out;
+    uint64_t at = 1700000000000000ull;
+    for (int i = 0; i < 64; ++i) {
+        at = i % 5 == 3 ? at - 12345 * i : at + (1ull << (i % 40));
+        std::string s(i % 7, 'a' + i % 26);
+        if (i % 3 == 0) s += std::string("\0x", 2);
+        out.push_back({(uint8_t)(1 + i % 10), at, i == 63 ? UINT64_MAX : (1ull << i) - 1, s, i * -0.5});
+    }
+    return out;
+}
+
+static std::string encode_log(const std::vector<TestRecord>& records, std::vector<size_t>* ends = nullptr) {
+    std::string out(kWalMagic, sizeof(kWalMagic)), scratch;
+    uint64_t last_us = 0;
+    for (const auto& r : records) {
+        wal_encode(out, scratch, last_us, r.type, r.at_us, WalFields().varint(r.n).string(r.s).number(r.d));
+        if (ends) ends->push_back(out.size());
+    }
+    return out;
+}
+
+static bool read_record(WalReader& reader, TestRecord& r) {
+    WalReader::Record rec;
+    if (!reader.next(rec)) return false;
+    WalFieldReader f(rec.fields);
+    r.type = rec.type;
+    r.at_us = rec.at_us;
+    return f.varint(r.n) && f.string(r.s) && f.number(r.d);
+}
+
+static bool same(const TestRecord& a, const TestRecord& b) {
+    return a.type == b.type && a.at_us == b.at_us && a.n == b.n && a.s == b.s && a.d == b.d;
+}
+
+static void test_round_trip() {
+    std::vector<TestRecord> records = sample_records();
+    WalReader reader;
+    CHECK(reader.load(encode_log(records)));
+    CHECK(reader.records() == records.size());
+    CHECK(reader.last_us() == records.back().at_us);
+    CHECK(reader.valid_size() == reader.size());
+    TestRecord r;
+    for (const auto& expected : records) CHECK(read_record(reader, r) && same(r, expected));
+    CHECK(!read_record(reader, r));
+
+    for (uint64_t v : std::vector<uint64_t>{0, 1, 127, 128, 16383, 16384, UINT32_MAX, UINT64_MAX}) {
+        std::string out;
+        wal_put_varint(out, v);
+        size_t pos = 0;
+        uint64_t back;
+        CHECK(wal_get_varint(out, pos, back) && back == v && pos == out.size());
+        pos = 0;
+        CHECK(!wal_get_varint(std::string_view(out).substr(0, out.size() - 1), pos, back));
+    }
+}
+
+// A log cut at any byte reads as the records that fit whole, and
+// valid_size() is where the last of them ends.
+static void test_every_cut() {
+    std::vector<TestRecord> records = sample_records();
+    std::vector<size_t> ends;
+    std::string log = encode_log(records, &ends);
+    for (size_t cut = 0; cut <= log.size(); ++cut) {
+        WalReader reader;
+        bool ok = reader.load(log.substr(0, cut));
+        CHECK(ok);
+        if (!ok) continue;
+        size_t whole = 0;
+        while (whole < ends.size() && ends[whole] <= cut) ++whole;
+        CHECK(reader.records() == whole);
+        CHECK(reader.valid_size() == (cut < sizeof(kWalMagic) ? 0 : whole ? ends[whole - 1] : sizeof(kWalMagic)));
+        CHECK(reader.last_us() == (whole ? records[whole - 1].at_us : 0));
+        TestRecord r;
+        for (size_t i = 0; i < whole; ++i) CHECK(read_record(reader, r) && same(r, records[i]));
+        CHECK(!read_record(reader, r));
+    }
+    WalReader reader;
+    CHECK(!reader.load("SRWAL02\n"));
+    CHECK(!reader.load("X"));
+}
+
+// A flipped byte anywhere in a record stops the reader at that record.
+static void test_corrupt_record() {
+    std::vector<TestRecord> records = sample_records();
+    std::vector<size_t> ends;
+    std::string log = encode_log(records, &ends);
+    size_t bad = 10, start = ends[bad - 1];
+    for (size_t at = start; at < ends[bad]; ++at) {
+        std::string copy = log;
+        copy[at] ^= 0x20;
+        WalReader reader;
+        CHECK(reader.load(copy));
+        CHECK(reader.records() == bad);
+        CHECK(reader.valid_size() == start);
+    }
+}
+
+// cut() ends the log before the record next() last returned.
+static void test_reader_cut() {
+    std::vector<TestRecord> records = sample_records();
+    std::vector<size_t> ends;
+    WalReader reader;
+    reader.load(encode_log(records, &ends));
+    TestRecord r;
+    for (int i = 0; i < 5; ++i) read_record(reader, r);
+    reader.cut();
+    CHECK(reader.records() == 4);
+    CHECK(reader.valid_size() == ends[3]);
+    CHECK(reader.last_us() == records[3].at_us);
+    CHECK(!read_record(reader, r));
+}
+
+// Toy state for the snapshot test: type 1 starts a poll, type 2 is a
+// response, type 3 sets both counters (as a snapshot's first record).
+struct Counters {
+    uint64_t poll = 0, seq = 0, records = 0, last_us = 0;
+};
+
+static Counters replay_counters(const std::string& path) {
+    WalReader reader;
+    std::string error;
+    Counters c;
+    if (!reader.open(path, error)) return c;
+    WalReader::Record r;
+    while (reader.next(r)) {
+        WalFieldReader f(r.fields);
+        if (r.type == 1) ++c.poll;
+        if (r.type == 2) ++c.seq;
+        if (r.type == 3 && !(f.varint(c.poll) && f.varint(c.seq))) break;
+        ++c.records;
+    }
+    c.last_us = reader.last_us();
+    return c;
+}
+
+// A snapshot ending at the log's last timestamp, plus the records
+// appended while it is written, replays to the same counters as the full
+// log; so does the log when the replacement cannot be written.
+static void test_snapshot_replace() {
+    std::string path = temp_path("wal_test_snapshot.wal"), full = temp_path("wal_test_full.wal");
+    std::remove(path.c_str());
+    std::remove(full.c_str());
+    WalWriter w, reference;
+    std::string error;
+    CHECK(w.open(path, 0, error));
+    CHECK(reference.open(full, 0, error));
+    uint64_t at = 1000, poll = 0, seq = 0;
+    auto append = [&](uint8_t type) {
+        at += type == 1 ? 5000 : 3;
+        if (type == 1) ++poll;
+        if (type == 2) ++seq;
+        w.append(type, at, WalFields());
+        reference.append(type, at, WalFields());
+    };
+    for (int i = 0; i < 3000; ++i) append(i % 500 == 0 ? 1 : 2);
+
+    for (int round = 0; round < 2; ++round) {
+        uint64_t image_poll = poll, image_seq = seq;
+        uint64_t end_us = w.start_tail();
+        std::atomic<bool> done{false};
+        std::thread appender([&] {
+            for (int i = 0; i < 2000 || !done.load(); ++i) append(i % 700 == 0 ? 1 : 2);
+        });
+        std::string image(kWalMagic, sizeof(kWalMagic)), scratch;
+        uint64_t last_us = 0;
+        wal_encode(image, scratch, last_us, 3, end_us, WalFields().varint(image_poll).varint(image_seq));
+        std::string tmp = path + ".new";
+        bool ok;
+        if (round == 0) {
+            std::FILE* f = std::fopen(tmp.c_str(), "wb");
+            ok = f && std::fwrite(image.data(), 1, image.size(), f) == image.size() && std::fclose(f) == 0;
+            CHECK(ok && w.replace(tmp, path, error));
+        } else {
+            // No such directory: the old log must be kept and appended to.
+            CHECK(!w.replace(temp_path("wal_test_missing") + "/x.new", path, error));
+        }
+        done = true;
+        appender.join();
+        append(2);
+    }
+    w.close();
+    reference.close();
+    Counters got = replay_counters(path), want = replay_counters(full);
+    CHECK(got.poll == want.poll && got.poll == poll);
+    CHECK(got.seq == want.seq && got.seq == seq);
+    CHECK(got.last_us == want.last_us && got.last_us == at);
+    CHECK(got.records < want.records);
+    std::remove(path.c_str());
+    std::remove(full.c_str());
+}
+
+// A commit that fails is cut back off the file and retried; nothing is
+// counted committed until it lands, and the log reads back whole.
+static void test_commit_failure() {
+#ifndef _WIN32
+    std::string path = temp_path("wal_test_fail.wal");
+    std::remove(path.c_str());
+    std::signal(SIGXFSZ, SIG_IGN);
+    rlimit old;
+    getrlimit(RLIMIT_FSIZE, &old);
+    WalWriter w;
+    std::string error;
+    CHECK(w.open(path, 0, error));
+    w.append(1, 10, WalFields().string("before"));
+    while (w.committed() < 1) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    uint64_t size = std::filesystem::file_size(path);
+    rlimit limit = old;
+    limit.rlim_cur = size + 40;
+    setrlimit(RLIMIT_FSIZE, &limit);
+    for (int i = 0; i < 20; ++i) w.append(2, 20 + i, WalFields().string("a record that does not fit"));
+    std::this_thread::sleep_for(WalWriter::kCommitInterval * 5);
+    CHECK(w.failing());
+    CHECK(w.committed() == 1);
+    CHECK(std::filesystem::file_size(path) == size);
+    setrlimit(RLIMIT_FSIZE, &old);
+    for (int i = 0; i < 200 && w.committed() < 21; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK(!w.failing());
+    CHECK(w.committed() == 21);
+    w.close();
+    WalReader reader;
+    CHECK(reader.load(read_file(path)));
+    CHECK(reader.records() == 21);
+    CHECK(reader.valid_size() == reader.size());
+    CHECK(reader.last_us() == 39);
+    std::remove(path.c_str());
+#endif
+}
+
+int main() {
+    test_round_trip();
+    test_every_cut();
+    test_corrupt_record();
+    test_reader_cut();
+    test_snapshot_replace();
+    test_commit_failure();
+    if (g_failures) std::fprintf(stderr, "%d check(s) failed\n", g_failures);
+    else std::printf("wal_test: all checks passed\n");
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+// Short-text answer normalization and frequency ranking.
+//
+// Raw answers are folded to a match key once per distinct text (trimmed,
+// whitespace collapsed, ASCII case folded, and optionally stripped of
+// punctuation). TopKCounter keeps an exact count per key in the
+// stream-summary layout: keys hang off buckets of equal count ordered by
+// count, so +1/-1 is O(1) and the K most frequent keys are read in O(K).
+
+#ifndef TEXT_ANSWERS_H
+#define TEXT_ANSWERS_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class TextMatch {
+    Exact,        // raw answer
+    Normalized,   // trimmed, whitespace collapsed, case folded
+    Fuzzy,        // normalized, and ASCII punctuation dropped
+};
+
+inline bool parse_text_match(const std::string& s, TextMatch& out) {
+    if (s == "exact") out = TextMatch::Exact;
+    else if (s == "normalized") out = TextMatch::Normalized;
+    else if (s == "fuzzy") out = TextMatch::Fuzzy;
+    else return false;
+    return true;
+}
+
+// Bytes >= 0x80 (UTF-8 sequences) pass through unchanged.
+inline std::string normalize_text_answer(std::string_view s, TextMatch mode) {
+    if (mode == TextMatch::Exact) return std::string(s);
+    std::string out;
+    out.reserve(s.size());
+    bool pending_space = false;
+    for (char ch : s) {
+        unsigned char c = (unsigned char)ch;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            pending_space = !out.empty();
+            continue;
+        }
+        if (mode == TextMatch::Fuzzy && c < 0x80 && !((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
+            continue;
+        if (pending_space) out += ' ';
+        pending_space = false;
+        out += (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : (char)c;
+    }
+    return out;
+}
+
+class TopKCounter {
+public:
+    void clear() {
+        count_.clear();
+        bucket_of_.clear();
+        prev_.clear();
+        next_.clear();
+        buckets_.clear();
+        free_buckets_.clear();
+        head_ = tail_ = kNil;
+    }
+
+    int64_t count(uint32_t key) const { return key < count_.size() ? count_[key] : 0; }
+
+    void increment(uint32_t key) {
+        grow(key);
+        int32_t b = bucket_of_[key];
+        // Buckets run from the highest count (head_) down to tail_. The key
+        // moves to the bucket just above its current one; a key at zero is in
+        // no bucket and moves up from below the tail.
+        int32_t above = b == kNil ? tail_ : buckets_[b].prev;
+        int64_t c = ++count_[key];
+        int32_t target;
+        if (above != kNil && buckets_[above].count == c) {
+            target = above;
+        } else {
+            target = new_bucket(c);
+            link_bucket_after(target, above);
+        }
+        if (b != kNil) unlink_key(key, b);
+        link_key(key, target);
+    }
+
+    void decrement(uint32_t key) {
+        if (key >= count_.size() || count_[key] == 0) return;
+        int32_t b = bucket_of_[key];
+        int64_t c = --count_[key];
+        if (c > 0) {
+            int32_t below = buckets_[b].next;
+            int32_t target;
+            if (below != kNil && buckets_[below].count == c) {
+                target = below;
+            } else {
+                target = new_bucket(c);
+                link_bucket_after(target, b);
+            }
+            unlink_key(key, b);
+            link_key(key, target);
+        } else {
+            unlink_key(key, b);
+            bucket_of_[key] = kNil;
+        }
+    }
+
+    // Calls fn(key, count) for up to k keys in descending count order.
+    template <class Fn>
+    void top(size_t k, Fn&& fn) const {
+        for (int32_t b = head_; b != kNil && k; b = buckets_[b].next) {
+            for (int32_t key = buckets_[b].first; key != kNil && k; key = next_[key], --k) fn((uint32_t)key, buckets_[b].count);
+        }
+    }
+
+private:
+    static constexpr int32_t kNil = -1;
+
+    struct Bucket {
+        int64_t count;
+        int32_t first;   // first key in this bucket
+        int32_t prev;    // bucket with the next higher count
+        int32_t next;    // bucket with the next lower count
+    };
+
+    void grow(uint32_t key) {
+        if (key < count_.size()) return;
+        count_.resize(key + 1, 0);
+        bucket_of_.resize(key + 1, kNil);
+        prev_.resize(key + 1, kNil);
+        next_.resize(key + 1, kNil);
+    }
+
+    int32_t new_bucket(int64_t count) {
+        int32_t b;
+        if (!free_buckets_.empty()) {
+            b = free_buckets_.back();
+            free_buckets_.pop_back();
+        } else {
+            b = (int32_t)buckets_.size();
+            buckets_.push_back({});
+        }
+        buckets_[b] = {count, kNil, kNil, kNil};
+        return b;
+    }
+
+    // Inserts bucket b directly below `above` (at the head if above is kNil).
+    void link_bucket_after(int32_t b, int32_t above) {
+        int32_t below = above == kNil ? head_ : buckets_[above].next;
+        buckets_[b].prev = above;
+        buckets_[b].next = below;
+        if (above == kNil) head_ = b;
+        else buckets_[above].next = b;
+        if (below == kNil) tail_ = b;
+        else buckets_[below].prev = b;
+    }
+
+    void unlink_bucket(int32_t b) {
+        int32_t above = buckets_[b].prev, below = buckets_[b].next;
+        if (above == kNil) head_ = below;
+        else buckets_[above].next = below;
+        if (below == kNil) tail_ = above;
+        else buckets_[below].prev = above;
+        free_buckets_.push_back(b);
+    }
+
+    void link_key(uint32_t key, int32_t b) {
+        prev_[key] = kNil;
+        next_[key] = buckets_[b].first;
+        if (buckets_[b].first != kNil) prev_[buckets_[b].first] = (int32_t)key;
+        buckets_[b].first = (int32_t)key;
+        bucket_of_[key] = b;
+    }
+
+    void unlink_key(uint32_t key, int32_t b) {
+        if (prev_[key] != kNil) next_[prev_[key]] = next_[key];
+        else buckets_[b].first = next_[key];
+        if (next_[key] != kNil) prev_[next_[key]] = prev_[key];
+        if (buckets_[b].first == kNil) unlink_bucket(b);
+    }
+
+    std::vector<int64_t> count_;
+    std::vector<int32_t> bucket_of_;
+    std::vector<int32_t> prev_;
+    std::vector<int32_t> next_;
+    std::vector<Bucket> buckets_;
+    std::vector<int32_t> free_buckets_;
+    int32_t head_ = kNil;
+    int32_t tail_ = kNil;
+};
+
+#endif
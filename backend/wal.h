@@ -0,0 +1,466 @@
+// Append-only write-ahead log.
+//
+// A log file is an 8-byte magic followed by records framed as
+//   varint length | payload | CRC-32 of payload (4 bytes, little-endian)
+// with a payload of
+//   type (1 byte) | zigzag varint timestamp delta (us) | fields
+// where the delta is from the previous record's timestamp (0 for the
+// first record of a file). Fields are varints, length-prefixed strings
+// and 8-byte doubles, written with WalFields and read with WalFieldReader;
+// what the types and fields mean is up to the caller.
+//
+// WalWriter::append only encodes the record into a memory buffer. A
+// background thread writes the buffer out and syncs it every
+// kCommitInterval, or sooner once kCommitBytes are pending, so one write
+// and one sync cover every record appended in that window (group commit).
+// A record is durable once the commit that follows it completes. A
+// commit that fails is cut back off the file and retried, so the file
+// never holds a partial record ahead of later ones.
+// WalWriter::replace swaps in a rewritten log (a snapshot) while appends
+// carry on.
+//
+// WalReader::open checks every record's CRC and stops at the first record
+// that is cut short or corrupt, which is where a crash mid-write leaves
+// the tail; valid_size() is where the writer should continue.
+
+#ifndef WAL_H
+#define WAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Flushes f's data to the device.
+inline bool sync_file(std::FILE* f) {
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fdatasync(fileno(f)) == 0;
+#endif
+}
+
+// Cuts f back to size bytes.
+inline bool truncate_file(std::FILE* f, uint64_t size) {
+#ifdef _WIN32
+    return _chsize_s(_fileno(f), (long long)size) == 0;
+#else
+    return ftruncate(fileno(f), (off_t)size) == 0;
+#endif
+}
+
+static constexpr char kWalMagic[8] = {'S', 'R', 'W', 'A', 'L', '0', '1', '\n'};
+
+inline uint32_t wal_crc32(const char* data, size_t len) {
+    static const struct Table {
+        uint32_t t[256];
+        Table() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+        }
+    } table;
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i) c = table.t[(c ^ (unsigned char)data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+inline void wal_put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+// Reads a varint at data[pos], advancing pos. False if truncated or too long.
+inline bool wal_get_varint(std::string_view data, size_t& pos, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+        unsigned char b = (unsigned char)data[pos++];
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Record fields, in the order they are read back.
+class WalFields {
+public:
+    WalFields& varint(uint64_t v) {
+        wal_put_varint(out_, v);
+        return *this;
+    }
+    WalFields& string(std::string_view s) {
+        wal_put_varint(out_, s.size());
+        out_.append(s);
+        return *this;
+    }
+    WalFields& number(double v) {
+        char b[8];
+        memcpy(b, &v, 8);   // little-endian hosts only, like the rest of the format
+        out_.append(b, 8);
+        return *this;
+    }
+    const std::string& data() const { return out_; }
+
+private:
+    std::string out_;
+};
+
+// Appends one framed record to out; last_us is the previous record's
+// timestamp and is advanced to at_us. scratch is reused for the payload.
+inline void wal_encode(std::string& out, std::string& scratch, uint64_t& last_us, uint8_t type, uint64_t at_us, const WalFields& fields) {
+    scratch.clear();
+    scratch += (char)type;
+    int64_t delta = (int64_t)(at_us - last_us);
+    wal_put_varint(scratch, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    scratch += fields.data();
+    last_us = at_us;
+    wal_put_varint(out, scratch.size());
+    out += scratch;
+    uint32_t crc = wal_crc32(scratch.data(), scratch.size());
+    for (int i = 0; i < 4; ++i) out += (char)(crc >> (8 * i));
+}
+
+// Reads fields in the order they were written; every getter returns false
+// once a field is missing or malformed.
+class WalFieldReader {
+public:
+    explicit WalFieldReader(std::string_view data) : data_(data) {}
+
+    bool varint(uint64_t& v) { return wal_get_varint(data_, pos_, v); }
+    bool string(std::string& s) {
+        uint64_t len;
+        if (!varint(len) || len > data_.size() - pos_) return false;
+        s.assign(data_.data() + pos_, (size_t)len);
+        pos_ += (size_t)len;
+        return true;
+    }
+    bool number(double& v) {
+        if (data_.size() - pos_ < 8) return false;
+        memcpy(&v, data_.data() + pos_, 8);
+        pos_ += 8;
+        return true;
+    }
+
+private:
+    std::string_view data_;
+    size_t pos_ = 0;
+};
+
+class WalWriter {
+public:
+    static constexpr auto kCommitInterval = std::chrono::milliseconds(10);
+    static constexpr size_t kCommitBytes = 256 * 1024;
+    static constexpr auto kRetryInterval = std::chrono::milliseconds(500);
+
+    WalWriter() = default;
+    WalWriter(const WalWriter&) = delete;
+    WalWriter& operator=(const WalWriter&) = delete;
+    ~WalWriter() { close(); }
+
+    // Opens path for appending and starts the commit thread. A new or empty
+    // file gets the magic; last_us is the timestamp of the file's last
+    // record, from which the next delta is taken.
+    bool open(const std::string& path, uint64_t last_us, std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        file_ = std::fopen(path.c_str(), "ab");
+        if (!file_) {
+            error = "Cannot open " + path + " for appending";
+            return false;
+        }
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+        std::fseek(file_, 0, SEEK_END);
+        size_ = (uint64_t)std::ftell(file_);
+        if (size_ == 0) buffer_.assign(kWalMagic, sizeof(kWalMagic));
+        last_us_ = last_us;
+        open_ = running_ = true;
+        thread_ = std::thread(&WalWriter::commit_loop, this);
+        return true;
+    }
+
+    bool is_open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return open_;
+    }
+
+    // Queues a record; never blocks on I/O. A no-op while the log is closed.
+    void append(uint8_t type, uint64_t at_us, const WalFields& fields) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!open_) return;
+        size_t at = buffer_.size();
+        wal_encode(buffer_, payload_, last_us_, type, at_us, fields);
+        if (tailing_) tail_.append(buffer_, at, std::string::npos);
+        ++appended_;
+        if (buffer_.size() >= kCommitBytes) wake_.notify_one();
+    }
+
+    // Starts keeping a copy of every record appended from now on, for
+    // replace(), and returns the timestamp of the last one before;
+    // stop_tail() drops it.
+    uint64_t start_tail() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tail_.clear();
+        tailing_ = true;
+        return last_us_;
+    }
+    void stop_tail() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tail_.clear();
+        tailing_ = false;
+    }
+
+    // Makes the log at path the file replacement followed by every record
+    // appended since start_tail(), and goes on appending there. replacement
+    // must be a complete log whose last record is timed like the last one
+    // appended before start_tail(), so the copied records' deltas hold after
+    // it as they do in the old log. Appends are queued meanwhile and never
+    // wait on this. The copied records are synced into replacement before it
+    // is renamed over path, so records that were durable stay durable. If
+    // that fails the old log is kept and appending continues there.
+    bool replace(const std::string& replacement, const std::string& path, std::string& error) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) {
+                error = "log is closed";
+                return false;
+            }
+            running_ = false;
+        }
+        wake_.notify_one();
+        thread_.join();
+        std::string tail;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tail = tail_;
+        }
+        size_t copied = tail.size();
+        std::FILE* f = std::fopen(replacement.c_str(), "ab");
+        bool ok = f && std::fwrite(tail.data(), 1, tail.size(), f) == tail.size() && std::fflush(f) == 0 && sync_file(f);
+        if (f && std::fclose(f) != 0) ok = false;
+        if (!ok) error = "cannot write " + replacement;
+        std::error_code ec;
+        if (ok) {
+            std::fclose(file_);     // Windows cannot rename over an open file
+            std::filesystem::rename(replacement, path, ec);
+            if (ec) error = "cannot replace " + path + ": " + ec.message();
+            ok = !ec;
+            file_ = std::fopen(path.c_str(), "ab");
+            if (file_) {
+                std::setvbuf(file_, nullptr, _IONBF, 0);
+                std::fseek(file_, 0, SEEK_END);
+                size_ = (uint64_t)std::ftell(file_);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ok) buffer_ = tail_.substr(copied);     // what was appended since the copy
+        tail_.clear();
+        tailing_ = false;
+        if (!file_) {
+            open_ = false;
+            error = "cannot reopen " + path;
+            return false;
+        }
+        running_ = true;
+        thread_ = std::thread(&WalWriter::commit_loop, this);
+        return ok;
+    }
+
+    // Commits what is pending and closes the file.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) return;
+            running_ = false;
+        }
+        wake_.notify_one();
+        thread_.join();
+        std::fclose(file_);
+        file_ = nullptr;
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_ = false;
+    }
+
+    uint64_t appended() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return appended_;
+    }
+    uint64_t committed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return committed_;
+    }
+    // True while commits fail; the records are kept and retried.
+    bool failing() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return failed_;
+    }
+    // Timestamp of the last record appended, to reopen the file with.
+    uint64_t last_us() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_us_;
+    }
+
+private:
+    void commit_loop() {
+        std::string out;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait_for(lock, kCommitInterval, [&] { return !running_ || buffer_.size() >= kCommitBytes; });
+            bool stopping = !running_;
+            if (!buffer_.empty()) {
+                out.swap(buffer_);
+                uint64_t target = appended_;
+                lock.unlock();
+                bool ok = std::fwrite(out.data(), 1, out.size(), file_) == out.size() && sync_file(file_);
+                // Records after a partial one would be unreadable.
+                if (!ok) truncate_file(file_, size_);
+                lock.lock();
+                if (ok) {
+                    size_ += out.size();
+                    committed_ = target;
+                    if (failed_) std::fprintf(stderr, "Write-ahead log: writing again\n");
+                    failed_ = false;
+                } else {
+                    buffer_.insert(0, out);
+                    if (!failed_) std::fprintf(stderr, "Write-ahead log: write failed; retrying\n");
+                    failed_ = true;
+                }
+                out.clear();
+                if (failed_ && !stopping) wake_.wait_for(lock, kRetryInterval, [&] { return !running_; });
+            }
+            if (stopping) break;
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    std::FILE* file_ = nullptr; // written by the commit thread only while it runs
+    bool open_ = false;         // appends are taken
+    bool running_ = false;      // the commit thread runs
+    bool tailing_ = false;
+    bool failed_ = false;       // the last commit failed
+    std::string buffer_;        // encoded records not yet written
+    std::string payload_;       // scratch for append
+    std::string tail_;          // records appended since start_tail()
+    uint64_t size_ = 0;         // bytes of the file known whole; like file_
+    uint64_t last_us_ = 0;
+    uint64_t appended_ = 0;
+    uint64_t committed_ = 0;
+};
+
+class WalReader {
+public:
+    struct Record {
+        uint8_t type = 0;
+        uint64_t at_us = 0;
+        std::string_view fields;
+    };
+
+    // Reads the file and validates its records. A missing file reads as an
+    // empty log, and so does one cut short inside the magic (a crash before
+    // the first commit finished), with valid_size() 0; false only for a
+    // file that is not a log at all.
+    bool open(const std::string& path, std::string& error) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return true;
+        if (load(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()))) return true;
+        error = path + " is not a write-ahead log";
+        return false;
+    }
+
+    // Same as open, for a log already in memory.
+    bool load(std::string data) {
+        data_ = std::move(data);
+        valid_ = pos_ = 0;
+        records_ = last_us_ = at_ = 0;
+        if (data_.size() < sizeof(kWalMagic)) return memcmp(data_.data(), kWalMagic, data_.size()) == 0;
+        if (memcmp(data_.data(), kWalMagic, sizeof(kWalMagic)) != 0) return false;
+        size_t pos = sizeof(kWalMagic);
+        uint64_t at = 0;
+        for (;;) {
+            size_t start = pos;
+            Record r;
+            if (!frame(pos, r, at)) {
+                valid_ = start;
+                break;
+            }
+            ++records_;
+        }
+        last_us_ = at;
+        pos_ = last_pos_ = sizeof(kWalMagic);
+        at_ = last_at_ = read_ = 0;
+        return true;
+    }
+
+    // The next valid record, in file order.
+    bool next(Record& r) {
+        if (pos_ >= valid_) return false;
+        last_pos_ = pos_;
+        last_at_ = at_;
+        ++read_;
+        return frame(pos_, r, at_);
+    }
+
+    // Treats the log as ending before the record next() last returned, as
+    // for a torn tail: valid_size(), records() and last_us() then describe
+    // what was read before it.
+    void cut() {
+        if (!read_) return;
+        valid_ = pos_ = last_pos_;
+        at_ = last_us_ = last_at_;
+        records_ = --read_;
+    }
+
+    size_t size() const { return data_.size(); }
+    size_t valid_size() const { return valid_; }
+    uint64_t records() const { return records_; }
+    uint64_t last_us() const { return last_us_; }
+
+private:
+    bool frame(size_t& pos, Record& r, uint64_t& at) {
+        std::string_view all(data_);
+        uint64_t len, delta;
+        if (!wal_get_varint(all, pos, len) || len == 0 || len + 4 > all.size() - pos) return false;
+        std::string_view payload = all.substr(pos, (size_t)len);
+        uint32_t crc = 0;
+        for (int i = 0; i < 4; ++i) crc |= (uint32_t)(unsigned char)all[pos + (size_t)len + i] << (8 * i);
+        if (crc != wal_crc32(payload.data(), payload.size())) return false;
+        size_t p = 1;
+        if (!wal_get_varint(payload, p, delta)) return false;
+        at += (uint64_t)((int64_t)(delta >> 1) ^ -(int64_t)(delta & 1));
+        r.type = (uint8_t)payload[0];
+        r.at_us = at;
+        r.fields = payload.substr(p);
+        pos += (size_t)len + 4;
+        return true;
+    }
+
+    std::string data_;
+    size_t valid_ = 0;
+    size_t pos_ = 0;
+    size_t last_pos_ = 0;           // where the record next() last returned starts
+    uint64_t at_ = 0;
+    uint64_t last_at_ = 0;          // timestamp of the record before it
+    uint64_t read_ = 0;             // records next() returned
+    uint64_t records_ = 0;
+    uint64_t last_us_ = 0;
+};
+
+#endif
@@ -1,8 +1,17 @@
-import React, { useState } from 'react';
+import React, { useEffect, useState } from 'react';
 
 function App() {
   const [status, setStatus] = useState("");
   const [results, setResults] = useState([]);
+  const [summary, setSummary] = useState(null);
+  const [live, setLive] = useState(false);
+
+  useEffect(() => {
+    if (!live) return undefined;
+    const source = new EventSource('http://localhost:8080/poll/stream');
+    source.addEventListener('summary', e => setSummary(JSON.parse(e.data)));
+    return () => source.close();
+  }, [live]);
 
   const startPoll = async () => {
     const res = await fetch('http://localhost:8080/poll/start', { method: 'POST' });
@@ -19,6 +28,11 @@ function App() {
     const data = await res.json();
     setResults(data.results);
   };
+  const getSummary = async () => {
+    const res = await fetch('http://localhost:8080/poll/summary');
+    const data = await res.json();
+    setSummary(data);
+  };
 
   return (
     <div style={{padding: 40}}>
@@ -26,11 +40,25 @@ function App() {
       <button onClick={startPoll}>Start Poll</button>
       <button onClick={stopPoll}>Stop Poll</button>
       <button onClick={getResults}>Get Results</button>
+      <button onClick={getSummary}>Get Summary</button>
+      <label>
+        <input type="checkbox" checked={live} onChange={e => setLive(e.target.checked)} /> Live
+      </label>
       <div>Status: {status}</div>
       <div>
         <h2>Results</h2>
         <pre>{JSON.stringify(results, null, 2)}</pre>
       </div>
+      {summary && (
+        <div>
+          <h2>Summary ({summary.responses} responses)</h2>
+          <ul>
+            {summary.choices.map(c => (
+              <li key={c.label}>{c.label}{c.text ? `: ${c.text}` : ''} - {c.count}</li>
+            ))}
+          </ul>
+        </div>
+      )}
     </div>
   );
 }